@@ -12,18 +12,18 @@
 
 #include <random>
 
-extern Sound::GlitchSynth synths[Sound::NUM_SYNTHS];
-
 GLuint glitch_meshes_for_lit_color_texture_program = 0;
 
-Load< MeshBuffer > glitch_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("glitch.pnct"));
-	glitch_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+Load< MeshBuffer > glitch_meshes(LoadTagDefault, LoadOnWorkerThread, {lit_color_texture_program}, []() -> MeshBuffer const * {
+	MeshBuffer const *ret = new MeshBuffer(data_path("glitch.pnct"), MeshBuffer::Compact);
+	run_on_main_thread([&](){
+		glitch_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	});
 	return ret;
 });
 
-Load< Scene > glitch_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("glitch.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+Load< Scene > glitch_scene(LoadTagDefault, LoadOnWorkerThread, {glitch_meshes, lit_color_texture_program}, []() -> Scene const * {
+	return new Scene(data_path("glitch.scene"), [&](Scene &scene, Scene::Transform transform, std::string const &mesh_name){
 		Mesh const &mesh = glitch_meshes->lookup(mesh_name);
 		scene.drawables.emplace_back(transform);
 		Scene::Drawable &drawable = scene.drawables.back();
@@ -34,11 +34,14 @@ Load< Scene > glitch_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_to_object = mesh.position_to_object;
+		drawable.pipeline.octahedral_normals = mesh.octahedral_normals;
 
 	});
 });
 
-GlitchMode::GlitchMode() : scene(*glitch_scene) {
+GlitchMode::GlitchMode() : song(GlitchSong::DEFAULT_SEED), scene(*glitch_scene) {
 	static std::mt19937 mt;
 
 	//get pointer to camera for convenience:
@@ -46,26 +49,12 @@ GlitchMode::GlitchMode() : scene(*glitch_scene) {
 	camera = &scene.cameras.front();
 
 	// get handles to spheres
-	for (auto& transform : scene.transforms) {
-		if (transform.name == "Sphere") {
-			sphere_transforms[0] = &transform;
-		}
-		else if (transform.name == "Sphere.001") {
-			sphere_transforms[1] = &transform;
-		}
-		else if (transform.name == "Sphere.002") {
-			sphere_transforms[2] = &transform;
-		}
-		else if (transform.name == "Sphere.003") {
-			sphere_transforms[3] = &transform;
-		}
-		else if (transform.name == "Sphere.004") {
-			sphere_transforms[4] = &transform;
-		}
-		else if (transform.name == "Cylinder") {
-			cylinder_transform = &transform;
-		}
-	}
+	sphere_transforms[0] = scene.find_transform("Sphere");
+	sphere_transforms[1] = scene.find_transform("Sphere.001");
+	sphere_transforms[2] = scene.find_transform("Sphere.002");
+	sphere_transforms[3] = scene.find_transform("Sphere.003");
+	sphere_transforms[4] = scene.find_transform("Sphere.004");
+	cylinder_transform = scene.find_transform("Cylinder");
 
 	assert(sphere_transforms[0]);
 	assert(sphere_transforms[1]);
@@ -73,105 +62,28 @@ GlitchMode::GlitchMode() : scene(*glitch_scene) {
 	assert(sphere_transforms[3]);
 	assert(sphere_transforms[4]);
 	assert(cylinder_transform);
-	cylinder_position = cylinder_transform->position;
+	cylinder_position = scene.position(cylinder_transform);
 	
 	
 
 	for (int i = 0; i < 5; i++) {
-		sphere_transforms[i]->position.z = 8.0f * mt()/float(mt.max()) - 4.0f;
-		sphere_transforms[i]->position.x = 8.0f * mt()/float(mt.max()) - 4.0f;
-		sphere_transforms[i]->position.y = 8.0f * mt()/float(mt.max()) - 4.0f;
-	}
-
-
-	// TODO: set these using an asset pipeline
-	// source for GlitchSynth in Sound.hpp and Sound.cpp
-	// despite a moderate amount of effort, it still sounds pretty bad
-	// TODO: implement an actually decent LPF, reverb, and compressor
-	synths[BASS_SYNTH].set_attack(1.0f, 100);
-	synths[BASS_SYNTH].set_decay(0.8f, 200);
-	synths[BASS_SYNTH].set_sustain(0.8f);
-	synths[BASS_SYNTH].set_release(0.0f, 20000);
-	synths[BASS_SYNTH].osc = Sound::GlitchSynth::OSC_SINE;
-	synths[BASS_SYNTH].volume = 1.0f;
-
-	synths[HAT_SYNTH].set_attack(1.0f, 100);
-	synths[HAT_SYNTH].set_decay(0.3f, 500);
-	synths[HAT_SYNTH].set_sustain(0.0f);
-	synths[HAT_SYNTH].set_release(0.0f, 1);
-	synths[HAT_SYNTH].osc = Sound::GlitchSynth::OSC_NOISE;
-	synths[HAT_SYNTH].volume = 0.5f;
-
-	synths[SNARE_SYNTH].set_attack(1.0f, 1000);
-	synths[SNARE_SYNTH].set_decay(0.3f, 2000);
-	synths[SNARE_SYNTH].set_sustain(0.0f);
-	synths[SNARE_SYNTH].set_release(0.0f, 3000);
-	synths[SNARE_SYNTH].osc = Sound::GlitchSynth::OSC_SAW;
-	synths[SNARE_SYNTH].volume = 0.5f;
-	
-	synths[KICK_SYNTH].set_attack(1.0f, 500);
-	synths[KICK_SYNTH].set_decay(0.8f, 500);
-	synths[KICK_SYNTH].set_sustain(0.0f);
-	synths[KICK_SYNTH].set_release(0.0f, 1);
-	synths[KICK_SYNTH].osc = Sound::GlitchSynth::OSC_SQUARE;
-	synths[KICK_SYNTH].volume = 1.0f;
-
-	synths[PLAYER_LEAD_SYNTH].set_attack(1.0f, 500);
-	synths[PLAYER_LEAD_SYNTH].set_decay(0.7f, 500);
-	synths[PLAYER_LEAD_SYNTH].set_sustain(0.7f);
-	synths[PLAYER_LEAD_SYNTH].set_release(0.0f, 10000);
-	synths[PLAYER_LEAD_SYNTH].osc = Sound::GlitchSynth::OSC_SINE;
-	synths[PLAYER_LEAD_SYNTH].volume = 0.5f;
-
-	synths[PLAYER_SUPER_SYNTH].set_attack(1.0f, 500);
-	synths[PLAYER_SUPER_SYNTH].set_decay(0.7f, 500);
-	synths[PLAYER_SUPER_SYNTH].set_sustain(0.7f);
-	synths[PLAYER_SUPER_SYNTH].set_release(0.0f, 10000);
-	synths[PLAYER_SUPER_SYNTH].osc = Sound::GlitchSynth::OSC_SAW;
-	synths[PLAYER_SUPER_SYNTH].volume = 0.1f;
-
-
-	loops.emplace_back(synths[BASS_SYNTH]);
-	loops.emplace_back(synths[HAT_SYNTH]);
-	loops.emplace_back(synths[SNARE_SYNTH]);
-	loops.emplace_back(synths[KICK_SYNTH]);
-
-	// 4 indices per beat.
-	// loop notation:
-	// 	1. positive number: start playing note id, 1 means C0, 2 means C#0, and so on
-	// 	2. any negative number: stop playing current note - triggers ADSR_RELEASE
-	// 	3. 0: ignore, just for timing
-
-	// TODO: generate these procedurally for some variety, hardcoding for now
-
-	// garbage bassline
-	// warning: this sounds terrible
-	for (int i = 0; i < 32; i++) {
-		loops[BASS_SYNTH].note_commands.push_back(24 + mt() % 12);
-		for (int _i = 0; _i < 11; _i++) {
-			loops[BASS_SYNTH].note_commands.push_back(0);
-		}
-		loops[BASS_SYNTH].note_commands.push_back(-1);
-		loops[BASS_SYNTH].note_commands.push_back(0);
-		loops[BASS_SYNTH].note_commands.push_back(0);
-		loops[BASS_SYNTH].note_commands.push_back(0);
+		scene.position(sphere_transforms[i]).z = 8.0f * mt()/float(mt.max()) - 4.0f;
+		scene.position(sphere_transforms[i]).x = 8.0f * mt()/float(mt.max()) - 4.0f;
+		scene.position(sphere_transforms[i]).y = 8.0f * mt()/float(mt.max()) - 4.0f;
 	}
-	
-	// monotonous hi-hat
-	loops[HAT_SYNTH].note_commands = {1, -1, 0, 0};
-
-	// uninspired snare
-	loops[SNARE_SYNTH].note_commands = {0, 0, 0, 0,  0, 0, 0, 0,  36+1, -1, 0, 0,  0, 0, 0, 0};
-
-	// insipid kick
-	loops[KICK_SYNTH].note_commands = {12+1, -1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 24+1, -1,
-									   12+1, -1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
-
+}
 
+GlitchMode::~GlitchMode() {
+}
 
+void GlitchMode::player_note_on(int note) {
+	Sound::note_on(song.player_lead, note, freq_table[note]);
+	Sound::note_on(song.player_super, note, freq_table[(note+7)%12] / 2.0f);
 }
 
-GlitchMode::~GlitchMode() {
+void GlitchMode::player_note_off(int note) {
+	Sound::note_off(song.player_lead, note);
+	Sound::note_off(song.player_super, note);
 }
 
 
@@ -181,120 +93,84 @@ bool GlitchMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 		int played_note = -1;
 		if (evt.key.keysym.sym == SDLK_a) {
 			if (!a_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[0]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(0+7)%12] / 2.0f);
+				player_note_on(0);
 				played_note = 0;
 			}
 			a_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_w) {
 			if (!w_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[1]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(1+7)%12]  / 2.0f);
+				player_note_on(1);
 				played_note = 1;
 			}
 			w_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_s) {
 			if (!s_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[2]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(2+7)%12]  / 2.0f);
+				player_note_on(2);
 				played_note = 2;
 			}
 			s_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_e) {
 			if (!e_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[3]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(3+7)%12] / 2.0f);
+				player_note_on(3);
 				played_note = 3;
 			}
 			e_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_d) {
 			if (!d_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[4]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(4+7)%12] / 2.0f);
+				player_note_on(4);
 				played_note = 4;
 			}
 			d_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_f) {
 			if (!f_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[5]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(5+7)%12] / 2.0f);
+				player_note_on(5);
 				played_note = 5;
 			}
 			f_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_t) {
 			if (!t_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[6]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(6+7)%12] / 2.0f);
+				player_note_on(6);
 				played_note = 6;
 			}
 			t_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_g) {
 			if (!g_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[7]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(7+7)%12] / 2.0f);
+				player_note_on(7);
 				played_note = 7;
 			}
 			g_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_y) {
 			if (!y_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[8]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(8+7)%12] / 2.0f);
+				player_note_on(8);
 				played_note = 8;
 			}
 			y_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_h) {
 			if (!h_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[9]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(9+7)%12] / 2.0f);
+				player_note_on(9);
 				played_note = 9;
 			}
 			h_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_u) {
 			if (!u_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[10]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(10+7)%12] / 2.0f);
+				player_note_on(10);
 				played_note = 10;
 			}
 			u_b.pressed = true;
 		}
 		else if (evt.key.keysym.sym == SDLK_j) {
 			if (!j_b.pressed){
-				synths[PLAYER_LEAD_SYNTH].is_on = true;
-				synths[PLAYER_SUPER_SYNTH].is_on = true;
-				synths[PLAYER_LEAD_SYNTH].play(freq_table[11]);
-				synths[PLAYER_SUPER_SYNTH].play(freq_table[(11+7)%12] / 2.0f);
+				player_note_on(11);
 				played_note = 11;
 			}
 			j_b.pressed = true;
@@ -312,63 +188,51 @@ bool GlitchMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 		
 	} else if (evt.type == SDL_KEYUP) {
 		if (evt.key.keysym.sym == SDLK_a) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(0);
 			a_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_w) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(1);
 			w_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_s) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(2);
 			s_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_e) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(3);
 			e_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_d) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(4);
 			d_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_f) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(5);
 			f_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_t) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(6);
 			t_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_g) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(7);
 			g_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_y) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(8);
 			y_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_h) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(9);
 			h_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_u) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(10);
 			u_b.pressed = false;
 		}
 		else if (evt.key.keysym.sym == SDLK_j) {
-			synths[PLAYER_LEAD_SYNTH].do_release = true;
-			synths[PLAYER_SUPER_SYNTH].do_release = true;
+			player_note_off(11);
 			j_b.pressed = false;
 		}
 	}
@@ -379,47 +243,29 @@ bool GlitchMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_siz
 void GlitchMode::update(float elapsed) {
 	static std::mt19937 mt;
 
-	// update synth loops
-	// TODO: this is not a great frame-independent update loop, fix lag
-	loop_delay += elapsed;
-	if (loop_delay >= 0.13f) {
-		for (int i = 0; i < loops.size(); i++) {
-			int command = loops[i].note_commands[loops[i].current_idx];
-			loops[i].current_idx = (loops[i].current_idx + 1) % (loops[i].note_commands.size());
-			if (command != 0) {
-				if (command > 0) {
-					int idx = (command - 1) % 12;
-					int octave = (command - 1) / 12 - 4;
-					float freq = freq_table[idx] * powf(2.0f, float(octave));
-					loops[i].synth.is_on = true;
-					loops[i].synth.play(freq);
-					if (i == BASS_SYNTH) {
-						target_note = idx;
-						new_target = true;
-					}
-				}
-				else {
-					loops[i].synth.do_release = true;
-				}
-			}
+	// synth loops are stepped by the audio thread; just pick up the bass notes it played
+	Sound::SequenceEvent event;
+	while (Sound::poll_sequence_event(&event)) {
+		if (event.sequence == BASS_SYNTH) {
+			target_note = (event.note - 1) % 12;
+			new_target = true;
 		}
-		loop_delay = 0.f;
 	}
 
 	// move spheres
 	for (int i = 0; i < 5; i++) {
-		float z = sphere_transforms[i]->position.z;
+		float z = scene.position(sphere_transforms[i]).z;
 		if (direction == UP) {
 			z = z - elapsed * 5.f;
 			if (z < -6.f) z = 6.f;
-			cylinder_transform->position.x = cylinder_position.x;
+			scene.position(cylinder_transform).x = cylinder_position.x;
 		}
 		else {
 			z = z + elapsed * 20.f;
 			if (z > 6.0f) z = -6.0f;
-			cylinder_transform->position.x = cylinder_position.x + mt()/float(mt.max()) - 0.5f;
+			scene.position(cylinder_transform).x = cylinder_position.x + mt()/float(mt.max()) - 0.5f;
 		}
-		sphere_transforms[i]->position.z = z;
+		scene.position(sphere_transforms[i]).z = z;
 	}
 }
 
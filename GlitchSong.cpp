@@ -0,0 +1,140 @@
+#include "GlitchSong.hpp"
+
+#include <random>
+#include <vector>
+#include <cmath>
+
+namespace {
+	struct SynthLoop {
+		// rudimentary note-on, note-off commands
+		std::vector<int> note_commands;
+
+		// instrument (see Sound::add_instrument) playing this loop
+		int instrument;
+
+		SynthLoop(int instrument_) : instrument(instrument_) {}
+	};
+}
+
+GlitchSong::GlitchSong(uint32_t seed) {
+	std::mt19937 mt(seed);
+	std::vector< SynthLoop > loops;
+
+	// TODO: set these using an asset pipeline
+	// source for GlitchSynth in Sound.hpp and Sound.cpp
+	// despite a moderate amount of effort, it still sounds pretty bad
+	// TODO: implement a decent reverb and compressor
+	Sound::GlitchSynth patch;
+
+	patch.set_attack(1.0f, 100);
+	patch.set_decay(0.8f, 200);
+	patch.set_sustain(0.8f);
+	patch.set_release(0.0f, 20000);
+	patch.osc = Sound::GlitchSynth::OSC_SINE;
+	patch.volume = 1.0f;
+	loops.emplace_back(Sound::add_instrument(patch, 4));
+
+	patch.set_attack(1.0f, 100);
+	patch.set_decay(0.3f, 500, Sound::GlitchSynth::CURVE_EXPONENTIAL);
+	patch.set_sustain(0.0f);
+	patch.set_release(0.0f, 1);
+	patch.osc = Sound::GlitchSynth::OSC_NOISE;
+	patch.noise_shape = Sound::GlitchSynth::NOISE_TRIANGULAR;
+	patch.volume = 0.5f;
+	loops.emplace_back(Sound::add_instrument(patch, 2));
+
+	patch.set_attack(1.0f, 1000);
+	patch.set_decay(0.3f, 2000, Sound::GlitchSynth::CURVE_EXPONENTIAL);
+	patch.set_sustain(0.0f);
+	patch.set_release(0.0f, 3000, Sound::GlitchSynth::CURVE_EXPONENTIAL);
+	patch.osc = Sound::GlitchSynth::OSC_SAW;
+	patch.volume = 0.5f;
+	patch.filter = Sound::GlitchSynth::FILTER_BANDPASS;
+	patch.filter_cutoff = 1500.0f;
+	patch.filter_resonance = 0.9f;
+	loops.emplace_back(Sound::add_instrument(patch, 2));
+	
+	patch.set_attack(1.0f, 500);
+	patch.set_decay(0.8f, 500);
+	patch.set_sustain(0.0f);
+	patch.set_release(0.0f, 1);
+	patch.osc = Sound::GlitchSynth::OSC_SQUARE;
+	patch.volume = 1.0f;
+	patch.filter = Sound::GlitchSynth::FILTER_OFF;
+	loops.emplace_back(Sound::add_instrument(patch, 2));
+
+	patch.set_attack(1.0f, 500);
+	patch.set_decay(0.7f, 500);
+	patch.set_sustain(0.7f);
+	patch.set_release(0.0f, 10000);
+	patch.osc = Sound::GlitchSynth::OSC_SINE;
+	patch.volume = 0.5f;
+	player_lead = Sound::add_instrument(patch, 8);
+
+	patch.set_attack(1.0f, 500);
+	patch.set_decay(0.7f, 500);
+	patch.set_sustain(0.7f);
+	patch.set_release(0.0f, 10000);
+	patch.osc = Sound::GlitchSynth::OSC_SAW;
+	patch.volume = 0.1f;
+	patch.filter = Sound::GlitchSynth::FILTER_LOWPASS;
+	patch.filter_cutoff = 2000.0f;
+	patch.filter_resonance = 1.2f;
+	player_super = Sound::add_instrument(patch, 8);
+
+	// 4 indices per beat.
+	// loop notation:
+	// 	1. positive number: start playing note id, 1 means C0, 2 means C#0, and so on
+	// 	2. any negative number: stop playing current note - triggers ADSR_RELEASE
+	// 	3. 0: ignore, just for timing
+
+	// TODO: generate these procedurally for some variety, hardcoding for now
+
+	// garbage bassline
+	// warning: this sounds terrible
+	for (int i = 0; i < 32; i++) {
+		loops[BASS_SYNTH].note_commands.push_back(24 + mt() % 12);
+		for (int _i = 0; _i < 11; _i++) {
+			loops[BASS_SYNTH].note_commands.push_back(0);
+		}
+		loops[BASS_SYNTH].note_commands.push_back(-1);
+		loops[BASS_SYNTH].note_commands.push_back(0);
+		loops[BASS_SYNTH].note_commands.push_back(0);
+		loops[BASS_SYNTH].note_commands.push_back(0);
+	}
+	
+	// monotonous hi-hat
+	loops[HAT_SYNTH].note_commands = {1, -1, 0, 0};
+
+	// uninspired snare
+	loops[SNARE_SYNTH].note_commands = {0, 0, 0, 0,  0, 0, 0, 0,  36+1, -1, 0, 0,  0, 0, 0, 0};
+
+	// insipid kick
+	loops[KICK_SYNTH].note_commands = {12+1, -1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 24+1, -1,
+									   12+1, -1, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0, 0};
+
+	// hand the loops to the audio thread's sequencer, which keeps time by sample position
+	std::vector< Sound::Sequence > sequences;
+	for (auto const &loop : loops) {
+		sequences.emplace_back();
+		Sound::Sequence &sequence = sequences.back();
+		sequence.instrument = loop.instrument;
+		for (int command : loop.note_commands) {
+			Sound::Sequence::Step step;
+			step.note = command;
+			if (command > 0) {
+				int idx = (command - 1) % 12;
+				int octave = (command - 1) / 12 - 4;
+				step.frequency = freq_table[idx] * powf(2.0f, float(octave));
+			}
+			sequence.steps.emplace_back(step);
+		}
+	}
+	// the player chases the bassline, so update() needs to hear about bass notes:
+	sequences[BASS_SYNTH].report_notes = true;
+	Sound::play_sequences(sequences, LOOP_BPM, LOOP_SWING);
+}
+
+GlitchSong::~GlitchSong() {
+	Sound::clear_instruments();
+}
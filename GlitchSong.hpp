@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Sound.hpp"
+
+#include <cstdint>
+
+/*
+ * GlitchSong sets up the game's instruments and starts their loops on Sound's sequencer.
+ * It has no graphics dependencies, so it can be played by GlitchMode or rendered offline (see main.cpp).
+ */
+
+// sequence indices (for Sound::SequenceEvent::sequence)
+// B A S S
+constexpr int BASS_SYNTH = 0; 
+
+// Drums
+constexpr int HAT_SYNTH = 1;
+constexpr int SNARE_SYNTH = 2;
+constexpr int KICK_SYNTH = 3;
+
+// synth loop tempo (4 steps per beat) and swing (fraction of a step that every other step is delayed by)
+constexpr float LOOP_BPM = 115.0f;
+constexpr float LOOP_SWING = 0.0f;
+
+// note frequencies analyzed from a real synth
+// TODO: not quite correct
+constexpr float freq_table[12] = {
+	261.f,  //C4
+	277.f,  //C#4
+	293.f,  //D4
+	311.f,  //D#4
+	329.f,  //E4
+	349.f,  //F4
+	370.f,  //F#4
+	391.f,  //G4
+	415.f,  //G#4
+	440.f,  //A4
+	467.f,  //A#4
+	494.f   //B4
+};
+
+struct GlitchSong {
+	//registers the instruments and starts the loops; 'seed' picks the bassline:
+	GlitchSong(uint32_t seed);
+	//releases the instruments:
+	~GlitchSong();
+
+	static constexpr uint32_t DEFAULT_SEED = 5489;
+
+	// meowdleeeooooowwldelooww
+	int player_lead = -1;
+
+	// copies the lead half-octave higher for that layered "supersaw" sound
+	int player_super = -1;
+};
@@ -21,6 +21,7 @@ struct LitColorTextureProgram {
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint OCTAHEDRAL_NORMALS_bool = -1U; //Normal.xy holds octahedral coordinates (MeshBuffer::Compact)
 
 	//lighting:
 	GLuint LIGHT_TYPE_int = -1U;
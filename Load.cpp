@@ -1,32 +1,369 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	enum LoadState : uint32_t {
+		LoadIdle, //not requested (yet)
+		LoadWaiting, //requested, waiting on dependencies
+		LoadQueued,
+		LoadRunning,
+		LoadDone,
+		LoadFailed,
+	};
+
+	struct LoadJob {
+		LoadTag tag;
+		std::function< void() > fn;
+		LoadThread thread = LoadOnMainThread;
+		bool ordered_by_tag = true; //if false, waits on 'dependencies' instead of earlier tags
+		std::vector< uint32_t const * > dependencies;
+
+		//filled in by call_load_functions():
+		std::vector< uint32_t > depends_on;
+		std::vector< uint32_t > dependents;
+
+		//(all guarded by the scheduler's mutex)
+		LoadState state = LoadIdle;
+		uint32_t waiting_on = 0; //dependencies not yet done
+		bool requesting = false; //request_job() is requesting this job's dependencies (used to catch cycles)
+		std::exception_ptr error;
+	};
+
+	std::vector< LoadJob > &get_load_jobs() {
+		static std::vector< LoadJob > load_jobs;
+		return load_jobs;
+	}
+
+	//Main-thread work: loading functions and run_on_main_thread() requests.
+	// Called with 'cancel' set if the scheduler is shutting down before it got a chance to run.
+	typedef std::function< void(bool cancel) > MainTask;
+
+	struct LoadScheduler {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::thread::id main_thread;
+		bool started = false; //set by call_load_functions()
+		bool stopping = false;
+		std::deque< MainTask > main_queue;
+		std::deque< uint32_t > worker_queue;
+		std::vector< std::thread > workers;
+
+		//(constructed on first use -- after the job list -- so destroyed first, at exit:)
+		~LoadScheduler();
+	};
+
+	LoadScheduler &get_scheduler() {
+		static LoadScheduler scheduler;
+		return scheduler;
+	}
+}
+
+uint32_t add_load_function(LoadTag tag, std::function< void() > const &fn) {
+	auto &load_jobs = get_load_jobs();
+	assert(tag < MaxLoadTag);
+	assert(!get_scheduler().started && "load functions should be added before call_load_functions()");
+	load_jobs.emplace_back();
+	load_jobs.back().tag = tag;
+	load_jobs.back().fn = fn;
+	return uint32_t(load_jobs.size() - 1);
+}
+
+uint32_t add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread, std::vector< uint32_t const * > const &dependencies) {
+	uint32_t job = add_load_function(tag, fn);
+	auto &load_job = get_load_jobs()[job];
+	load_job.thread = thread;
+	load_job.ordered_by_tag = false;
+	load_job.dependencies = dependencies;
+	return job;
+}
+
+//---- scheduling (all of these are called with the scheduler's mutex held) ----
+
+static void run_load_job(std::unique_lock< std::mutex > &lock, uint32_t job);
+
+static void queue_job(uint32_t job) {
+	auto &scheduler = get_scheduler();
+	auto &load_job = get_load_jobs()[job];
+	assert(load_job.state == LoadWaiting && load_job.waiting_on == 0);
+	load_job.state = LoadQueued;
+	if (load_job.thread == LoadOnWorkerThread) {
+		scheduler.worker_queue.emplace_back(job);
+	} else {
+		scheduler.main_queue.emplace_back([job](bool cancel){
+			if (cancel) return;
+			std::unique_lock< std::mutex > lock(get_scheduler().mutex);
+			run_load_job(lock, job);
+		});
+	}
+	scheduler.cv.notify_all();
+}
+
+//mark a job failed, along with everything that was waiting on it:
+static void fail_job(uint32_t job, std::exception_ptr error) {
+	auto &load_jobs = get_load_jobs();
+	load_jobs[job].state = LoadFailed;
+	load_jobs[job].error = error;
+	for (uint32_t dependent : load_jobs[job].dependents) {
+		if (load_jobs[dependent].state == LoadWaiting) fail_job(dependent, error);
+	}
+}
+
+//request a job (and, first, everything it depends on):
+// (jobs in a dependency cycle -- e.g., an explicit-dependency Load listing a tag-ordered Load with a later tag -- fail)
+static void request_job(uint32_t job) {
+	auto &load_jobs = get_load_jobs();
+	auto &load_job = load_jobs[job];
+	if (load_job.state != LoadIdle) return;
+	load_job.state = LoadWaiting;
+	load_job.waiting_on = 0;
+	load_job.requesting = true;
+	for (uint32_t dependency : load_job.depends_on) {
+		if (load_jobs[dependency].requesting) {
+			fail_job(job, std::make_exception_ptr(std::runtime_error("Load dependencies form a cycle; some load functions can never run.")));
+			break;
+		}
+		request_job(dependency);
+		if (load_jobs[dependency].state == LoadFailed) {
+			fail_job(job, load_jobs[dependency].error);
+			break;
+		}
+		if (load_jobs[dependency].state != LoadDone) load_job.waiting_on += 1;
+	}
+	load_job.requesting = false;
+	if (load_job.state == LoadWaiting && load_job.waiting_on == 0) queue_job(job);
+}
+
+//claim a queued worker job so the calling thread can run it (rather than wait for a worker to get to it):
+static bool claim_worker_job(uint32_t job) {
+	auto &queue = get_scheduler().worker_queue;
+	auto f = std::find(queue.begin(), queue.end(), job);
+	if (f == queue.end()) return false;
+	queue.erase(f);
+	return true;
+}
+
+//---- running ----
+
+//run a queued job (on whatever thread), then queue anything that was waiting on it:
+// (called -- and returns -- with 'lock' held, so the job is marked running by whoever took it off a queue)
+static void run_load_job(std::unique_lock< std::mutex > &lock, uint32_t job) {
+	auto &scheduler = get_scheduler();
+	auto &load_jobs = get_load_jobs();
+	assert(lock.owns_lock());
+	assert(load_jobs[job].state == LoadQueued);
+	load_jobs[job].state = LoadRunning;
+	lock.unlock();
+
+	std::exception_ptr error;
+	try {
+		load_jobs[job].fn();
+	} catch (...) {
+		error = std::current_exception();
+	}
+
+	lock.lock();
+	load_jobs[job].fn = nullptr; //(free whatever the loading function captured)
+	if (error) {
+		fail_job(job, error);
+	} else {
+		load_jobs[job].state = LoadDone;
+		for (uint32_t dependent : load_jobs[job].dependents) {
+			if (load_jobs[dependent].state != LoadWaiting) continue;
+			assert(load_jobs[dependent].waiting_on > 0);
+			load_jobs[dependent].waiting_on -= 1;
+			if (load_jobs[dependent].waiting_on == 0) queue_job(dependent);
+		}
 	}
+	scheduler.cv.notify_all();
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+static void start_workers() {
+	auto &scheduler = get_scheduler();
+	//(the main thread also runs jobs, so one fewer worker than cores -- but at least one, so worker jobs make progress)
+	uint32_t worker_count = std::max(2U, std::thread::hardware_concurrency()) - 1;
+	for (uint32_t w = 0; w < worker_count; ++w) {
+		scheduler.workers.emplace_back([&scheduler](){
+			std::unique_lock< std::mutex > lock(scheduler.mutex);
+			while (true) {
+				scheduler.cv.wait(lock, [&](){ return scheduler.stopping || !scheduler.worker_queue.empty(); });
+				if (scheduler.stopping) break;
+				uint32_t job = scheduler.worker_queue.front();
+				scheduler.worker_queue.pop_front();
+				run_load_job(lock, job);
+			}
+		});
+	}
+}
+
+//on the main thread, run main-thread work until 'done()' is true (called -- and returns -- with 'lock' held):
+template< typename F >
+static void run_main_thread_until(std::unique_lock< std::mutex > &lock, F const &done) {
+	auto &scheduler = get_scheduler();
+	assert(std::this_thread::get_id() == scheduler.main_thread);
+	while (!done()) {
+		if (!scheduler.main_queue.empty()) {
+			MainTask task = std::move(scheduler.main_queue.front());
+			scheduler.main_queue.pop_front();
+			lock.unlock();
+			task(false);
+			lock.lock();
+			continue;
+		}
+		//(request_job() fails any dependency cycles, so something will finish)
+		scheduler.cv.wait(lock);
+	}
+}
+
+LoadScheduler::~LoadScheduler() {
+	std::deque< MainTask > cancelled;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		stopping = true;
+		worker_queue.clear();
+		cancelled.swap(main_queue);
+		//(wakes up anything waiting in wait_for_load_function())
+		std::exception_ptr error = std::make_exception_ptr(std::runtime_error("Loading was cancelled."));
+		for (auto &load_job : get_load_jobs()) {
+			if (load_job.state == LoadWaiting || load_job.state == LoadQueued) {
+				load_job.state = LoadFailed;
+				load_job.error = error;
+			}
+		}
+		cv.notify_all();
+	}
+	//(wakes up any workers waiting in run_on_main_thread())
+	for (auto &task : cancelled) {
+		task(true);
+	}
+	for (auto &worker : workers) {
+		worker.join();
+	}
 }
 
 void call_load_functions() {
-	static bool has_been_called = false;
-	assert(!has_been_called && "call_load_functions should only be called *once*");
-	has_been_called = true;
+	auto &scheduler = get_scheduler();
+	assert(!scheduler.started && "call_load_functions should only be called *once*");
+
+	auto &load_jobs = get_load_jobs();
+	uint32_t const count = uint32_t(load_jobs.size());
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	//build the dependency graph:
+	for (uint32_t j = 0; j < count; ++j) {
+		auto &load_job = load_jobs[j];
+		if (load_job.ordered_by_tag) {
+			for (uint32_t i = 0; i < count; ++i) {
+				if (load_jobs[i].tag < load_job.tag) load_job.depends_on.emplace_back(i);
+			}
+		} else {
+			for (uint32_t const *dependency : load_job.dependencies) {
+				if (*dependency >= count) throw std::runtime_error("Load depends on something that isn't a registered load function.");
+				load_job.depends_on.emplace_back(*dependency);
+			}
+		}
+		for (uint32_t dependency : load_job.depends_on) {
+			load_jobs[dependency].dependents.emplace_back(j);
+		}
+	}
+
+	std::unique_lock< std::mutex > lock(scheduler.mutex);
+	scheduler.main_thread = std::this_thread::get_id();
+	scheduler.started = true;
+	start_workers();
+
+	//request everything that isn't lazy, then run main-thread work until it's all finished:
+	for (uint32_t j = 0; j < count; ++j) {
+		if (load_jobs[j].tag != LoadTagLazy) request_job(j);
+	}
+	run_main_thread_until(lock, [&](){
+		for (auto const &load_job : load_jobs) {
+			if (load_job.tag != LoadTagLazy && load_job.state != LoadDone && load_job.state != LoadFailed) return false;
 		}
+		return true;
+	});
+
+	for (auto const &load_job : load_jobs) {
+		if (load_job.tag != LoadTagLazy && load_job.state == LoadFailed) std::rethrow_exception(load_job.error);
+	}
+}
+
+void poll_load_functions() {
+	auto &scheduler = get_scheduler();
+	std::unique_lock< std::mutex > lock(scheduler.mutex);
+	if (!scheduler.started) return;
+	assert(std::this_thread::get_id() == scheduler.main_thread);
+	//(only what's queued now, so this can't stall the frame indefinitely)
+	for (size_t count = scheduler.main_queue.size(); count > 0 && !scheduler.main_queue.empty(); --count) {
+		MainTask task = std::move(scheduler.main_queue.front());
+		scheduler.main_queue.pop_front();
+		lock.unlock();
+		task(false);
+		lock.lock();
+	}
+}
+
+void prefetch_load_function(uint32_t job) {
+	auto &scheduler = get_scheduler();
+	std::unique_lock< std::mutex > lock(scheduler.mutex);
+	if (!scheduler.started) throw std::runtime_error("Lazy Load<> used before call_load_functions().");
+	request_job(job);
+}
+
+void wait_for_load_function(uint32_t job) {
+	auto &scheduler = get_scheduler();
+	auto &load_jobs = get_load_jobs();
+	std::unique_lock< std::mutex > lock(scheduler.mutex);
+	if (!scheduler.started) throw std::runtime_error("Lazy Load<> used before call_load_functions().");
+	request_job(job);
+
+	auto finished = [&](){
+		return load_jobs[job].state == LoadDone || load_jobs[job].state == LoadFailed;
+	};
+	if (load_jobs[job].state == LoadQueued && load_jobs[job].thread == LoadOnWorkerThread && claim_worker_job(job)) {
+		run_load_job(lock, job);
+	}
+	if (std::this_thread::get_id() == scheduler.main_thread) {
+		run_main_thread_until(lock, finished);
+	} else {
+		scheduler.cv.wait(lock, finished);
 	}
+
+	if (load_jobs[job].state == LoadFailed) std::rethrow_exception(load_jobs[job].error);
+}
+
+void run_on_main_thread(std::function< void() > const &fn) {
+	auto &scheduler = get_scheduler();
+	std::unique_lock< std::mutex > lock(scheduler.mutex);
+	if (!scheduler.started || std::this_thread::get_id() == scheduler.main_thread) {
+		lock.unlock();
+		fn();
+		return;
+	}
+	if (scheduler.stopping) throw std::runtime_error("Loading was cancelled.");
+
+	bool done = false;
+	std::exception_ptr error;
+	scheduler.main_queue.emplace_back([&](bool cancel){
+		if (cancel) {
+			error = std::make_exception_ptr(std::runtime_error("Loading was cancelled."));
+		} else try {
+			fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		std::unique_lock< std::mutex > lock(scheduler.mutex);
+		done = true;
+		scheduler.cv.notify_all();
+	});
+	scheduler.cv.notify_all();
+	scheduler.cv.wait(lock, [&](){ return done; });
+	lock.unlock();
+
+	if (error) std::rethrow_exception(error);
 }
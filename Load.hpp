@@ -20,51 +20,151 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loads may instead list the other Loads they depend on explicitly, and may ask to run on a worker thread:
+ *
+ * Load< Scene > main_scene(LoadTagDefault, LoadOnWorkerThread, {main_meshes, main_program}, []() -> Scene const * {
+ *     return new Scene(data_path("main.scene"), ...);
+ * });
+ *
+ * A Load with explicit dependencies starts as soon as those dependencies are done
+ * (its tag then only matters to tag-ordered Loads, which still wait for every Load with an earlier tag).
+ * Worker-thread loads must not touch OpenGL directly; wrap GL calls in run_on_main_thread().
+ * (a worker-thread load may also run on whichever thread is waiting for it -- including the main thread.)
+ *
+ * Loads tagged LoadTagLazy aren't loaded by call_load_functions(); they load on first dereference
+ * (blocking), or in the background after prefetch(). try_get() and ready() never block, so code
+ * can show something else until a lazy asset arrives:
+ *
+ * Load< Sound::Sample > music(LoadTagLazy, LoadOnWorkerThread, {}, ...);
+ * //in a mode's constructor:
+ * music.prefetch();
+ * //in update:
+ * if (Sound::Sample const *sample = music.try_get()) ...
+ *
  */
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <initializer_list>
 #include <stdexcept>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
 	LoadTagDefault,
 	LoadTagLate,
+	LoadTagLazy, //only loaded when used (or prefetched)
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
-//Add a function to an internal list of loading functions:
+enum LoadThread : uint32_t {
+	LoadOnMainThread, //(default; safe for OpenGL calls)
+	LoadOnWorkerThread,
+};
+
+//Add a function to an internal list of loading functions; returns an id that other functions can depend on:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+uint32_t add_load_function(LoadTag tag, std::function< void() > const &fn);
+//...with explicit dependencies instead of tag ordering (an empty list means "start right away"):
+// (dependencies point at ids rather than holding them because -- at static initialization time --
+//  the functions they refer to may not have been added yet.)
+uint32_t add_load_function(LoadTag tag, std::function< void() > const &fn, LoadThread thread, std::vector< uint32_t const * > const &dependencies);
 
-//Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+//Call all loading functions, using a pool of worker threads for LoadOnWorkerThread functions:
+// (loading functions may throw exceptions if they fail; the first exception is rethrown here once running functions finish.)
+// (Loads whose dependencies form a cycle -- counting the implicit ones of tag-ordered Loads -- fail with an exception rather than waiting forever.)
 // (only call *once*)
 void call_load_functions();
 
+//Run main-thread loading work requested by lazy Loads (and run_on_main_thread() requests):
+// (call once per frame from the main loop; doesn't block)
+void poll_load_functions();
+
+//Start loading a function (and whatever it depends on) in the background; used by Load< T >::prefetch():
+void prefetch_load_function(uint32_t job);
+//Load a function now, waiting for it (and rethrowing anything it threw); used by Load< T >::get():
+void wait_for_load_function(uint32_t job);
+
+//Run 'fn' on the main thread and wait for it to finish (rethrowing anything it throws):
+// (call this from worker-thread loading functions for OpenGL work; on the main thread -- or before
+//  call_load_functions() -- 'fn' is just called directly.)
+void run_on_main_thread(std::function< void() > const &fn);
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
 T const *new_T() { return new T; }
 
+template< typename T >
+struct Load;
+
+//Any Load<> can be listed as a dependency:
+struct LoadDependency {
+	template< typename T >
+	LoadDependency(Load< T > const &load) : job(&load.job) { }
+	uint32_t const *job;
+};
+
+inline std::vector< uint32_t const * > load_dependency_jobs(std::initializer_list< LoadDependency > dependencies) {
+	std::vector< uint32_t const * > jobs;
+	jobs.reserve(dependencies.size());
+	for (auto const &dependency : dependencies) {
+		jobs.emplace_back(dependency.job);
+	}
+	return jobs;
+}
+
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
-			this->value = load_fn();
-			if (!(this->value)) {
-				throw std::runtime_error("Loading failed.");
-			}
-		});
+		job = add_load_function(tag, wrap(load_fn));
+	}
+	//...or, with explicit dependencies, possibly on a worker thread:
+	Load(LoadTag tag, LoadThread thread, std::initializer_list< LoadDependency > dependencies, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+		job = add_load_function(tag, wrap(load_fn), thread, load_dependency_jobs(dependencies));
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
-	explicit operator bool() { return value != nullptr; }
-	operator T const *() { return value; }
-	T const &operator*() { return *value; }
-	T const *operator->() { return value; }
+	// (dereferencing a lazy Load that isn't ready waits for it)
+	explicit operator bool() const { return ready(); }
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	//Get the value, loading it now if needed:
+	T const *get() {
+		T const *ret = value.load(std::memory_order_acquire);
+		if (!ret) {
+			wait_for_load_function(job);
+			ret = value.load(std::memory_order_acquire);
+		}
+		return ret;
+	}
+	//Get the value if it's ready; otherwise start loading it (if needed) and return nullptr:
+	T const *try_get() {
+		T const *ret = value.load(std::memory_order_acquire);
+		if (!ret) prefetch_load_function(job);
+		return ret;
+	}
+	bool ready() const { return value.load(std::memory_order_acquire) != nullptr; }
+	//Start loading in the background:
+	void prefetch() { if (!ready()) prefetch_load_function(job); }
+
+	std::atomic< T const * > value;
+	uint32_t job;
 
-	T const *value;
+private:
+	std::function< void() > wrap(const std::function< T const *() > &load_fn) {
+		return [this,load_fn](){
+			T const *loaded = load_fn();
+			if (!loaded) {
+				throw std::runtime_error("Loading failed.");
+			}
+			this->value.store(loaded, std::memory_order_release);
+		};
+	}
 };
 
 
@@ -74,8 +174,13 @@ template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+		job = add_load_function(tag, load_fn);
+	}
+	Load( LoadTag tag, LoadThread thread, std::initializer_list< LoadDependency > dependencies, const std::function< void() > &load_fn) {
+		job = add_load_function(tag, load_fn, thread, load_dependency_jobs(dependencies));
 	}
+
+	uint32_t job;
 };
 
 
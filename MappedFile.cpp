@@ -0,0 +1,107 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(std::string const &filename) {
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping (error " + std::to_string(GetLastError()) + ").");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "' (error " + std::to_string(GetLastError()) + ").");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size > 0) {
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping) data = reinterpret_cast< uint8_t const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	//(the mapping keeps the file open)
+	CloseHandle(file);
+	if (size > 0 && !data) {
+		DWORD error = GetLastError();
+		unmap();
+		throw std::runtime_error("Failed to map '" + filename + "' (error " + std::to_string(error) + ").");
+	}
+}
+
+void MappedFile::unmap() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(std::string const &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping (" + std::strerror(errno) + ").");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		int error = errno;
+		close(fd);
+		throw std::runtime_error("Failed to stat '" + filename + "' (" + std::strerror(error) + ").");
+	}
+	size = size_t(info.st_size);
+	if (size > 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			int error = errno;
+			close(fd);
+			size = 0;
+			throw std::runtime_error("Failed to map '" + filename + "' (" + std::strerror(error) + ").");
+		}
+		data = reinterpret_cast< uint8_t const * >(mapped);
+	}
+	//(the mapping stays valid after the descriptor is closed)
+	close(fd);
+}
+
+void MappedFile::unmap() {
+	if (data) munmap(const_cast< uint8_t * >(data), size);
+	data = nullptr;
+	size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) {
+	*this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) {
+	if (this != &other) {
+		unmap();
+		std::swap(data, other.data);
+		std::swap(size, other.size);
+		#ifdef _WIN32
+		std::swap(mapping, other.mapping);
+		#endif
+	}
+	return *this;
+}
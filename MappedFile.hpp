@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * MappedFile - a read-only memory map of a whole file.
+ *
+ * Pages are read in by the OS on first touch (so "loading" costs about as much as the page faults),
+ * and processes that map the same file share the same physical pages.
+ *
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct MappedFile {
+	MappedFile() = default;
+	//map 'filename'; throws on error:
+	explicit MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile &&other);
+	MappedFile &operator=(MappedFile &&other);
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//file contents (nullptr if nothing is mapped or the file is empty):
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+
+	//internals:
+	void unmap();
+	#ifdef _WIN32
+	void *mapping = nullptr; //(HANDLE of the file mapping object)
+	#endif
+};
@@ -1,65 +1,175 @@
 #include "Mesh.hpp"
+#include "Load.hpp"
+#include "MappedFile.hpp"
 #include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
 #include <cstddef>
+#include <functional>
+#include <thread>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
 
-	std::ifstream file(filename, std::ios::binary);
+//vertex format of '.pnct' files:
+struct PnctVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(PnctVertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
 
-	GLuint total = 0;
+//vertex format of MeshBuffer::Compact buffers:
+struct CompactVertex {
+	glm::u16vec3 Position; //unorm16, relative to the mesh's bounding box
+	glm::i8vec2 Normal; //snorm8, octahedral coordinates
+	glm::u8vec4 Color;
+	glm::u16vec2 TexCoord; //half floats
+};
+static_assert(sizeof(CompactVertex) == 3*2+2*1+4*1+2*2, "Compact vertex is packed.");
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
-
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+//map a direction onto the [-1,1]^2 square by projecting it onto an octahedron and
+// folding the lower half over the diagonals (LitColorTextureProgram's vertex shader undoes this):
+static glm::vec2 octahedral_encode(glm::vec3 const &n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (l1 == 0.0f) return glm::vec2(0.0f);
+	glm::vec2 e(n.x / l1, n.y / l1);
+	if (n.z < 0.0f) {
+		e = glm::vec2(
+			(1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f)
+		);
+	}
+	return e;
+}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+//convert vertices [begin,end) -- which belong to a mesh with bounds [min,max] -- to the compact layout:
+static void compact_vertices(PnctVertex const *vertices, uint32_t begin, uint32_t end, glm::vec3 const &min, glm::vec3 const &max, CompactVertex *out) {
+	glm::vec3 to_unorm;
+	for (uint32_t c = 0; c < 3; ++c) {
+		to_unorm[c] = (max[c] > min[c] ? 65535.0f / (max[c] - min[c]) : 0.0f);
+	}
+	for (uint32_t v = begin; v < end; ++v) {
+		PnctVertex const &in = vertices[v];
+		for (uint32_t c = 0; c < 3; ++c) {
+			out[v].Position[c] = uint16_t(std::round(glm::clamp((in.Position[c] - min[c]) * to_unorm[c], 0.0f, 65535.0f)));
+		}
+		glm::vec2 e = octahedral_encode(in.Normal);
+		out[v].Normal = glm::i8vec2(
+			int8_t(std::round(glm::clamp(e.x, -1.0f, 1.0f) * 127.0f)),
+			int8_t(std::round(glm::clamp(e.y, -1.0f, 1.0f) * 127.0f))
+		);
+		out[v].Color = in.Color;
+		out[v].TexCoord = glm::u16vec2(glm::packHalf1x16(in.TexCoord.x), glm::packHalf1x16(in.TexCoord.y));
+	}
+}
 
-		total = GLuint(data.size()); //store total for later checks on index
+//expand [*min,*max] to hold the positions of vertices [begin,end):
+static void expand_bounds(PnctVertex const *vertices, uint32_t begin, uint32_t end, glm::vec3 *min_, glm::vec3 *max_) {
+	glm::vec3 &min = *min_;
+	glm::vec3 &max = *max_;
+	uint32_t v = begin;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	if (v < end) {
+		//each load grabs Position plus Normal.x (always inside the vertex, and ignored):
+		__m128 lo = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+		__m128 hi = _mm_setr_ps(max.x, max.y, max.z, 0.0f);
+		for (; v < end; ++v) {
+			__m128 p = _mm_loadu_ps(&vertices[v].Position.x);
+			lo = _mm_min_ps(lo, p);
+			hi = _mm_max_ps(hi, p);
+		}
+		alignas(16) float l[4], h[4];
+		_mm_store_ps(l, lo);
+		_mm_store_ps(h, hi);
+		min = glm::vec3(l[0], l[1], l[2]);
+		max = glm::vec3(h[0], h[1], h[2]);
+	}
+#endif
+	for (; v < end; ++v) {
+		min = glm::min(min, vertices[v].Position);
+		max = glm::max(max, vertices[v].Position);
+	}
+}
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+MeshBuffer::MeshBuffer(std::string const &filename, Layout layout_) : layout(layout_) {
+	//'.pnct' files hold triangle soup; '.pnci' files hold indexed triangles (see index-meshes.cpp):
+	bool indexed;
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
+		indexed = false;
+	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnci") {
+		indexed = true;
 	} else {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
+	//the file is mapped rather than read, so vertex data goes straight from the page cache to GL:
+	MappedFile file(filename);
+	uint8_t const *at = file.data;
+	uint8_t const *end = file.data + file.size;
+
+	//find data (and index) chunks:
+	size_t count = 0;
+	PnctVertex const *data = map_chunk< PnctVertex >(&at, end, "pnct", &count);
+	if (count > std::numeric_limits< GLuint >::max()) {
+		throw std::runtime_error("Mesh file '" + filename + "' has too many vertices.");
+	}
+	GLuint total = GLuint(count); //store total for later checks on index
+
+	uint32_t const *elements = nullptr;
+	size_t element_count = 0;
+	if (indexed) {
+		elements = map_chunk< uint32_t >(&at, end, "ix32", &element_count);
+		for (size_t i = 0; i < element_count; ++i) {
+			if (elements[i] >= total) throw std::runtime_error("Mesh file '" + filename + "' has an out-of-range vertex index.");
+		}
+	}
+
+	std::vector< CompactVertex > compact; //(filled in along with bounds, below, for the compact layout)
+
 	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	copy_chunk(&at, end, "str0", &strings);
 
 	{ //read index chunk, add to meshes:
 		struct IndexEntry {
 			uint32_t name_begin, name_end;
 			uint32_t vertex_begin, vertex_end;
+			uint32_t index_begin, index_end; //(only in '.pnci' files)
 		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
-
 		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		if (indexed) {
+			static_assert(sizeof(IndexEntry) == 24, "Index entry should be packed");
+			copy_chunk(&at, end, "idx1", &index);
+		} else {
+			struct SoupIndexEntry {
+				uint32_t name_begin, name_end;
+				uint32_t vertex_begin, vertex_end;
+			};
+			static_assert(sizeof(SoupIndexEntry) == 16, "Index entry should be packed");
+			std::vector< SoupIndexEntry > soup_index;
+			copy_chunk(&at, end, "idx0", &soup_index);
+			index.reserve(soup_index.size());
+			for (auto const &entry : soup_index) {
+				index.emplace_back(IndexEntry{entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end, 0, 0});
+			}
+		}
 
+		struct Added {
+			Mesh *mesh;
+			uint32_t vertex_begin, vertex_end;
+		};
+		std::vector< Added > added; //(bounds are filled in below)
 		for (auto const &entry : index) {
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
@@ -67,26 +177,138 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
+			if (indexed && !(entry.index_begin <= entry.index_end && entry.index_end <= element_count)) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
 			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			if (indexed) {
+				mesh.index_type = GL_UNSIGNED_INT;
+				mesh.start = entry.index_begin;
+				mesh.count = entry.index_end - entry.index_begin;
+			} else {
+				mesh.start = entry.vertex_begin;
+				mesh.count = entry.vertex_end - entry.vertex_begin;
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
+			auto inserted = meshes.insert(std::make_pair(name, mesh));
+			if (!inserted.second) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			} else {
+				added.emplace_back(Added{&inserted.first->second, entry.vertex_begin, entry.vertex_end});
+			}
+		}
+
+		//compact vertices are quantized to their mesh's bounds, so each vertex must belong to (at most) one mesh:
+		if (layout == Compact) {
+			std::vector< Added > sorted = added;
+			std::sort(sorted.begin(), sorted.end(), [](Added const &a, Added const &b){ return a.vertex_begin < b.vertex_begin; });
+			for (size_t i = 1; i < sorted.size(); ++i) {
+				if (sorted[i].vertex_begin < sorted[i-1].vertex_end) {
+					throw std::runtime_error("Mesh file '" + filename + "' has meshes that share vertices, so can't be loaded with the compact layout.");
+				}
+			}
+		}
+
+		//compute bounding boxes (and compact vertices), splitting big meshes into blocks that threads can share:
+		constexpr uint32_t BlockSize = 1 << 16;
+		struct Block {
+			Mesh *mesh;
+			uint32_t begin, end;
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		};
+		std::vector< Block > blocks;
+		for (auto const &a : added) {
+			for (uint32_t begin = a.vertex_begin; begin < a.vertex_end; begin += BlockSize) {
+				blocks.emplace_back();
+				blocks.back().mesh = a.mesh;
+				blocks.back().begin = begin;
+				blocks.back().end = std::min(a.vertex_end, begin + BlockSize);
+			}
+		}
+		auto for_each_block = [&](std::function< void(Block &) > const &fn) {
+			std::atomic< size_t > next_block(0);
+			auto do_blocks = [&](){
+				for (size_t b = next_block++; b < blocks.size(); b = next_block++) {
+					fn(blocks[b]);
+				}
+			};
+			//(threads only pay for themselves on big files)
+			uint32_t thread_count = std::min< uint32_t >(std::thread::hardware_concurrency(), uint32_t(blocks.size() / 4));
+			std::vector< std::thread > threads;
+			for (uint32_t t = 1; t < thread_count; ++t) {
+				threads.emplace_back(do_blocks);
+			}
+			do_blocks();
+			for (auto &thread : threads) {
+				thread.join();
+			}
+		};
+		for_each_block([&](Block &block){
+			expand_bounds(data, block.begin, block.end, &block.min, &block.max);
+		});
+		for (auto const &block : blocks) {
+			block.mesh->min = glm::min(block.mesh->min, block.min);
+			block.mesh->max = glm::max(block.mesh->max, block.max);
+		}
+
+		if (layout == Compact) {
+			compact.resize(total); //(vertices outside every mesh stay zero)
+			for_each_block([&](Block &block){
+				compact_vertices(data, block.begin, block.end, block.mesh->min, block.mesh->max, compact.data());
+			});
+			for (auto const &a : added) {
+				Mesh &mesh = *a.mesh;
+				if (a.vertex_begin == a.vertex_end) continue;
+				glm::vec3 size = mesh.max - mesh.min;
+				mesh.position_to_object = glm::mat4x3(
+					glm::vec3(size.x, 0.0f, 0.0f),
+					glm::vec3(0.0f, size.y, 0.0f),
+					glm::vec3(0.0f, 0.0f, size.z),
+					mesh.min
+				);
+				mesh.octahedral_normals = true;
 			}
 		}
 	}
 
-	if (file.peek() != EOF) {
+	if (at != end) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
+	//upload data (MeshBuffers may be loaded on a worker thread, but GL calls belong on the main thread):
+	run_on_main_thread([&](){
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (layout == Compact) {
+			glBufferData(GL_ARRAY_BUFFER, total * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+		} else {
+			glBufferData(GL_ARRAY_BUFFER, total * sizeof(PnctVertex), data, GL_STATIC_DRAW);
+		}
+		if (indexed) {
+			//(uploaded through the array buffer binding because the element array binding belongs to whatever VAO is bound;
+			// make_vao_for_program attaches it to each VAO)
+			glGenBuffers(1, &index_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+			glBufferData(GL_ARRAY_BUFFER, element_count * sizeof(uint32_t), elements, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	});
+
+	//store attrib locations:
+	if (layout == Compact) {
+		Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Position));
+		Normal = Attrib(2, GL_BYTE, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), offsetof(CompactVertex, TexCoord));
+	} else {
+		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(PnctVertex), offsetof(PnctVertex, Position));
+		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(PnctVertex), offsetof(PnctVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PnctVertex), offsetof(PnctVertex, Color));
+		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(PnctVertex), offsetof(PnctVertex, TexCoord));
+	}
+
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
 	for (auto const &m : meshes) {
@@ -128,6 +350,11 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//indexed meshes draw from the index buffer (this binding is stored in the vao):
+	if (index_buffer != 0) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	}
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
@@ -144,6 +371,10 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 		if (!bound.count(GLuint(location))) {
 			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
 		}
+		//compact normals only make sense to programs that know how to decode them:
+		if (layout == Compact && std::string(name) == "Normal" && glGetUniformLocation(program, "OCTAHEDRAL_NORMALS") == -1) {
+			throw std::runtime_error("ERROR: program reads 'Normal' from a compact MeshBuffer but has no OCTAHEDRAL_NORMALS uniform to decode it.");
+		}
 	}
 
 	return vao;
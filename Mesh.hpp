@@ -6,6 +6,10 @@
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
+ * MeshBuffers load triangle soup from '.pnct' files, or indexed triangles from
+ *  '.pnci' files (made from '.pnct' files by the index-meshes utility).
+ * Either can be stored in the file's 36-byte vertex layout or converted to a
+ *  16-byte compact layout (see MeshBuffer::Layout).
  *
  */
 
@@ -20,19 +24,31 @@ struct Mesh {
 	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or, for indexed meshes, of first index)
+	GLuint count = 0; //count of vertices (or indices)
+	GLenum index_type = GL_NONE; //GL_NONE for plain vertex ranges; otherwise the type of the indices in the MeshBuffer's index_buffer
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Vertex decoding (copy to Scene::Drawable::Pipeline along with type/start/count):
+	glm::mat4x3 position_to_object = glm::mat4x3(1.0f); //takes stored positions to object space (compact meshes store them relative to the bounding box)
+	bool octahedral_normals = false; //Normal holds two octahedral coordinates rather than a vector (compact meshes)
 };
 
 struct MeshBuffer {
+	//Vertex layouts:
+	enum Layout {
+		Full, //36 bytes: float3 position, float3 normal, u8x4 color, float2 texcoord (as stored in the file)
+		Compact, //16 bytes: unorm16x3 position within the mesh's bounding box, snorm8x2 octahedral normal, u8x4 color, half2 texcoord
+	};
+	//NOTE: programs that read Normal from Compact meshes must decode it when their OCTAHEDRAL_NORMALS uniform is set (see LitColorTextureProgram)
+
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, Layout layout = Full);
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
@@ -44,6 +60,10 @@ struct MeshBuffer {
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and, for indexed ('.pnci') files, the buffer of indices into it:
+	GLuint index_buffer = 0;
+
+	Layout layout = Full;
 
 	//-- internals ---
 
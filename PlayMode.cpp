@@ -13,14 +13,16 @@
 #include <random>
 
 GLuint hexapod_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > hexapod_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("hexapod.pnct"));
-	hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+Load< MeshBuffer > hexapod_meshes(LoadTagLazy, LoadOnWorkerThread, {lit_color_texture_program}, []() -> MeshBuffer const * {
+	MeshBuffer const *ret = new MeshBuffer(data_path("hexapod.pnci"), MeshBuffer::Compact);
+	run_on_main_thread([&](){
+		hexapod_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	});
 	return ret;
 });
 
-Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("hexapod.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+Load< Scene > hexapod_scene(LoadTagLazy, LoadOnWorkerThread, {hexapod_meshes, lit_color_texture_program}, []() -> Scene const * {
+	return new Scene(data_path("hexapod.scene"), [&](Scene &scene, Scene::Transform transform, std::string const &mesh_name){
 		Mesh const &mesh = hexapod_meshes->lookup(mesh_name);
 
 		scene.drawables.emplace_back(transform);
@@ -32,28 +34,29 @@ Load< Scene > hexapod_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_to_object = mesh.position_to_object;
+		drawable.pipeline.octahedral_normals = mesh.octahedral_normals;
 
 	});
 });
 
-Load< Sound::Sample > dusty_floor_sample(LoadTagDefault, []() -> Sound::Sample const * {
+Load< Sound::Sample > dusty_floor_sample(LoadTagLazy, LoadOnWorkerThread, {}, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("dusty-floor.opus"));
 });
 
 PlayMode::PlayMode() : scene(*hexapod_scene) {
-	//get pointers to leg for convenience:
-	for (auto &transform : scene.transforms) {
-		if (transform.name == "Hip.FL") hip = &transform;
-		else if (transform.name == "UpperLeg.FL") upper_leg = &transform;
-		else if (transform.name == "LowerLeg.FL") lower_leg = &transform;
-	}
-	if (hip == nullptr) throw std::runtime_error("Hip not found.");
-	if (upper_leg == nullptr) throw std::runtime_error("Upper leg not found.");
-	if (lower_leg == nullptr) throw std::runtime_error("Lower leg not found.");
-
-	hip_base_rotation = hip->rotation;
-	upper_leg_base_rotation = upper_leg->rotation;
-	lower_leg_base_rotation = lower_leg->rotation;
+	//get handles to leg for convenience:
+	hip = scene.find_transform("Hip.FL");
+	upper_leg = scene.find_transform("UpperLeg.FL");
+	lower_leg = scene.find_transform("LowerLeg.FL");
+	if (!hip) throw std::runtime_error("Hip not found.");
+	if (!upper_leg) throw std::runtime_error("Upper leg not found.");
+	if (!lower_leg) throw std::runtime_error("Lower leg not found.");
+
+	hip_base_rotation = scene.rotation(hip);
+	upper_leg_base_rotation = scene.rotation(upper_leg);
+	lower_leg_base_rotation = scene.rotation(lower_leg);
 
 	//get pointer to camera for convenience:
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
@@ -115,8 +118,8 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				evt.motion.xrel / float(window_size.y),
 				-evt.motion.yrel / float(window_size.y)
 			);
-			camera->transform->rotation = glm::normalize(
-				camera->transform->rotation
+			scene.rotation(camera->transform) = glm::normalize(
+				scene.rotation(camera->transform)
 				* glm::angleAxis(-motion.x * camera->fovy, glm::vec3(0.0f, 1.0f, 0.0f))
 				* glm::angleAxis(motion.y * camera->fovy, glm::vec3(1.0f, 0.0f, 0.0f))
 			);
@@ -133,21 +136,21 @@ void PlayMode::update(float elapsed) {
 	wobble += elapsed / 10.0f;
 	wobble -= std::floor(wobble);
 
-	hip->rotation = hip_base_rotation * glm::angleAxis(
+	scene.rotation(hip) = hip_base_rotation * glm::angleAxis(
 		glm::radians(5.0f * std::sin(wobble * 2.0f * float(M_PI))),
 		glm::vec3(0.0f, 1.0f, 0.0f)
 	);
-	upper_leg->rotation = upper_leg_base_rotation * glm::angleAxis(
+	scene.rotation(upper_leg) = upper_leg_base_rotation * glm::angleAxis(
 		glm::radians(7.0f * std::sin(wobble * 2.0f * 2.0f * float(M_PI))),
 		glm::vec3(0.0f, 0.0f, 1.0f)
 	);
-	lower_leg->rotation = lower_leg_base_rotation * glm::angleAxis(
+	scene.rotation(lower_leg) = lower_leg_base_rotation * glm::angleAxis(
 		glm::radians(10.0f * std::sin(wobble * 3.0f * 2.0f * float(M_PI))),
 		glm::vec3(0.0f, 0.0f, 1.0f)
 	);
 
 	//move sound to follow leg tip position:
-	leg_tip_loop->set_position(get_leg_tip_position(), 1.0f / 60.0f);
+	leg_tip_loop.set_position(get_leg_tip_position(), 1.0f / 60.0f);
 
 	//move camera:
 	{
@@ -163,16 +166,16 @@ void PlayMode::update(float elapsed) {
 		//make it so that moving diagonally doesn't go faster:
 		if (move != glm::vec2(0.0f)) move = glm::normalize(move) * PlayerSpeed * elapsed;
 
-		glm::mat4x3 frame = camera->transform->make_local_to_parent();
+		glm::mat4x3 frame = scene.make_local_to_parent(camera->transform);
 		glm::vec3 right = frame[0];
 		//glm::vec3 up = frame[1];
 		glm::vec3 forward = -frame[2];
 
-		camera->transform->position += move.x * right + move.y * forward;
+		scene.position(camera->transform) += move.x * right + move.y * forward;
 	}
 
 	{ //update listener to camera position:
-		glm::mat4x3 frame = camera->transform->make_local_to_parent();
+		glm::mat4x3 frame = scene.make_local_to_parent(camera->transform);
 		glm::vec3 right = frame[0];
 		glm::vec3 at = frame[3];
 		Sound::listener.set_position_right(at, right, 1.0f / 60.0f);
@@ -232,5 +235,5 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 glm::vec3 PlayMode::get_leg_tip_position() {
 	//the vertex position here was read from the model in blender:
-	return lower_leg->make_local_to_world() * glm::vec4(-1.26137f, -11.861f, 0.0f, 1.0f);
+	return scene.make_local_to_world(lower_leg) * glm::vec4(-1.26137f, -11.861f, 0.0f, 1.0f);
 }
@@ -29,9 +29,9 @@ struct PlayMode : Mode {
 	Scene scene;
 
 	//hexapod leg to wobble:
-	Scene::Transform *hip = nullptr;
-	Scene::Transform *upper_leg = nullptr;
-	Scene::Transform *lower_leg = nullptr;
+	Scene::Transform hip;
+	Scene::Transform upper_leg;
+	Scene::Transform lower_leg;
 	glm::quat hip_base_rotation;
 	glm::quat upper_leg_base_rotation;
 	glm::quat lower_leg_base_rotation;
@@ -40,7 +40,7 @@ struct PlayMode : Mode {
 	glm::vec3 get_leg_tip_position();
 
 	//music coming from the tip of the leg (as a demonstration):
-	std::shared_ptr< Sound::PlayingSample > leg_tip_loop;
+	Sound::PlayingSample leg_tip_loop;
 	
 	//camera:
 	Scene::Camera *camera = nullptr;
@@ -1,15 +1,98 @@
 #include "Scene.hpp"
 
-#include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <fstream>
+#include <stdexcept>
 
 //-------------------------
 
-glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+Scene::Transform Scene::add_transform(std::string const &name) {
+	uint32_t index;
+	if (!transforms.free_slots.empty()) {
+		index = transforms.free_slots.back();
+		transforms.free_slots.pop_back();
+	} else {
+		index = transforms.size();
+		transforms.name.emplace_back();
+		transforms.position.emplace_back();
+		transforms.rotation.emplace_back();
+		transforms.scale.emplace_back();
+		transforms.parent.emplace_back();
+		transforms.generation.emplace_back(0);
+		transforms.alive.emplace_back(0);
+	}
+	transforms.name[index] = name;
+	transforms.position[index] = glm::vec3(0.0f, 0.0f, 0.0f);
+	transforms.rotation[index] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
+	transforms.scale[index] = glm::vec3(1.0f, 1.0f, 1.0f);
+	transforms.parent[index] = -1U;
+	transforms.alive[index] = 1;
+
+	world_cache.order_stale = true;
+	world_cache.stale_slots.emplace_back(index);
+
+	Transform ret;
+	ret.index = index;
+	ret.generation = transforms.generation[index];
+	return ret;
+}
+
+void Scene::remove_transform(Transform transform) {
+	uint32_t index = slot(transform);
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (transforms.alive[i] && transforms.parent[i] == index) {
+			transforms.parent[i] = -1U;
+			world_cache.stale_slots.emplace_back(i);
+		}
+	}
+	transforms.alive[index] = 0;
+	transforms.generation[index] += 1;
+	transforms.free_slots.emplace_back(index);
+	world_cache.order_stale = true;
+}
+
+bool Scene::valid(Transform transform) const {
+	return transform.index < transforms.size()
+	    && transforms.alive[transform.index]
+	    && transforms.generation[transform.index] == transform.generation;
+}
+
+Scene::Transform Scene::transform_at(uint32_t index) const {
+	Transform ret;
+	if (index < transforms.size() && transforms.alive[index]) {
+		ret.index = index;
+		ret.generation = transforms.generation[index];
+	}
+	return ret;
+}
+
+Scene::Transform Scene::find_transform(std::string const &name) const {
+	for (uint32_t i = 0; i < transforms.size(); ++i) {
+		if (transforms.alive[i] && transforms.name[i] == name) return transform_at(i);
+	}
+	return Transform();
+}
+
+void Scene::set_parent(Transform transform, Transform parent) {
+	uint32_t index = slot(transform);
+	uint32_t parent_index = (parent ? slot(parent) : -1U);
+	for (uint32_t at = parent_index; at != -1U; at = transforms.parent[at]) {
+		if (at == index) throw std::runtime_error("Parenting '" + transforms.name[index] + "' to '" + transforms.name[parent_index] + "' would make a cycle.");
+	}
+	if (transforms.parent[index] == parent_index) return;
+	transforms.parent[index] = parent_index;
+	world_cache.order_stale = true;
+	world_cache.stale_slots.emplace_back(index);
+}
+
+//-------------------------
+
+//matrix helpers, from a slot's data:
+static glm::mat4x3 make_local_to_parent(Scene::Transforms const &transforms, uint32_t index) {
 	//compute:
 	//   translate   *   rotate    *   scale
 	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
@@ -17,7 +100,9 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
 	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
 
-	glm::mat3 rot = glm::mat3_cast(rotation);
+	glm::vec3 const &position = transforms.position[index];
+	glm::vec3 const &scale = transforms.scale[index];
+	glm::mat3 rot = glm::mat3_cast(transforms.rotation[index]);
 	return glm::mat4x3(
 		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
 		rot[1] * scale.y,
@@ -26,7 +111,7 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+static glm::mat4x3 make_parent_to_local(Scene::Transforms const &transforms, uint32_t index) {
 	//compute:
 	//   1/scale       *    rot^-1   *  translate^-1
 	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
@@ -34,6 +119,9 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	// [ 0 0 1/s.z 0 ]   [       0 ]   [ 0 0 0 -p.z ]
 	//                   [ 0 0 0 1 ]   [ 0 0 0  1   ]
 
+	glm::vec3 const &position = transforms.position[index];
+	glm::vec3 const &scale = transforms.scale[index];
+
 	glm::vec3 inv_scale;
 	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
 	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
@@ -41,7 +129,7 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
 
 	//compute inverse of rotation:
-	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
+	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(transforms.rotation[index]));
 
 	//scale the rows of rot:
 	inv_rot[0] *= inv_scale;
@@ -56,19 +144,51 @@ glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	);
 }
 
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+glm::mat4x3 Scene::make_local_to_parent(Transform transform) const {
+	return ::make_local_to_parent(transforms, slot(transform));
+}
+
+glm::mat4x3 Scene::make_parent_to_local(Transform transform) const {
+	return ::make_parent_to_local(transforms, slot(transform));
+}
+
+glm::mat4x3 Scene::make_local_to_world(Transform transform) const {
+	uint32_t index = slot(transform);
+	glm::mat4x3 ret = ::make_local_to_parent(transforms, index);
+	for (uint32_t at = transforms.parent[index]; at != -1U; at = transforms.parent[at]) {
+		ret = ::make_local_to_parent(transforms, at) * glm::mat4(ret); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
 	}
+	return ret;
 }
-glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+
+glm::mat4x3 Scene::make_world_to_local(Transform transform) const {
+	uint32_t index = slot(transform);
+	glm::mat4x3 ret = ::make_parent_to_local(transforms, index);
+	for (uint32_t at = transforms.parent[index]; at != -1U; at = transforms.parent[at]) {
+		ret = ret * glm::mat4(::make_parent_to_local(transforms, at)); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+	}
+	return ret;
+}
+
+glm::mat4x3 const &Scene::cached_local_to_world(Transform transform) const {
+	uint32_t index = slot(transform);
+	assert(index < world_cache.local_to_world.size() && "update_world_matrices() should have been called after adding this transform.");
+	return world_cache.local_to_world[index];
+}
+
+glm::mat4x3 const &Scene::cached_world_to_local(Transform transform) const {
+	uint32_t index = slot(transform);
+	assert(index < world_cache.world_to_local.size() && "update_world_matrices() should have been called after adding this transform.");
+	if (!world_cache.has_world_to_local[index]) {
+		uint32_t parent = transforms.parent[index];
+		if (parent == -1U) {
+			world_cache.world_to_local[index] = ::make_parent_to_local(transforms, index);
+		} else {
+			world_cache.world_to_local[index] = ::make_parent_to_local(transforms, index) * glm::mat4(cached_world_to_local(transform_at(parent)));
+		}
+		world_cache.has_world_to_local[index] = 1;
 	}
+	return world_cache.world_to_local[index];
 }
 
 //-------------------------
@@ -79,20 +199,179 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+void Scene::update_world_matrices() const {
+	WorldCache &cache = world_cache;
+	uint32_t const count = transforms.size();
+
+	if (cache.order_stale) {
+		cache.position.resize(count);
+		cache.rotation.resize(count);
+		cache.scale.resize(count);
+		cache.stale.resize(count, 1);
+		cache.changed.resize(count, 0);
+		cache.local_to_world.resize(count, glm::mat4x3(1.0f));
+		cache.has_world_to_local.resize(count, 0);
+		cache.world_to_local.resize(count, glm::mat4x3(1.0f));
+
+		//transforms made in hierarchy order (e.g., by load()) are already sorted, which keeps the pass below walking forward through memory:
+		cache.order.clear();
+		bool sorted = true;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!transforms.alive[i]) continue;
+			if (transforms.parent[i] != -1U && transforms.parent[i] > i) sorted = false;
+			cache.order.emplace_back(i);
+		}
+		if (!sorted) {
+			//otherwise, order by depth (stable, so slot order is kept within each level):
+			std::vector< uint32_t > depth(count, -1U);
+			for (uint32_t i : cache.order) {
+				//walk up to the nearest ancestor with a known depth, then fill in depths on the way back down:
+				uint32_t d = 0;
+				uint32_t at = i;
+				while (at != -1U && depth[at] == -1U) {
+					at = transforms.parent[at];
+					++d;
+				}
+				uint32_t base = (at == -1U ? 0 : depth[at] + 1);
+				for (at = i; at != -1U && depth[at] == -1U; at = transforms.parent[at]) {
+					--d;
+					depth[at] = base + d;
+				}
+			}
+			std::stable_sort(cache.order.begin(), cache.order.end(), [&depth](uint32_t a, uint32_t b){
+				return depth[a] < depth[b];
+			});
+		}
+		cache.order_stale = false;
+	}
+	for (uint32_t i : cache.stale_slots) {
+		cache.stale[i] = 1;
+	}
+	cache.stale_slots.clear();
+
+	//find transforms whose own position/rotation/scale changed (a straight sweep through the arrays):
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::quat const &r = transforms.rotation[i];
+		glm::quat const &cr = cache.rotation[i];
+		cache.changed[i] = cache.stale[i]
+			| (transforms.position[i] != cache.position[i])
+			| (r.x != cr.x) | (r.y != cr.y) | (r.z != cr.z) | (r.w != cr.w)
+			| (transforms.scale[i] != cache.scale[i]);
+	}
+
+	//recompute those (and everything below them), parents first:
+	for (uint32_t i : cache.order) {
+		uint32_t parent = transforms.parent[i];
+		if (parent != -1U) cache.changed[i] |= cache.changed[parent];
+		if (!cache.changed[i]) continue;
+
+		cache.position[i] = transforms.position[i];
+		cache.rotation[i] = transforms.rotation[i];
+		cache.scale[i] = transforms.scale[i];
+		cache.stale[i] = 0;
+		if (parent == -1U) {
+			cache.local_to_world[i] = ::make_local_to_parent(transforms, i);
+		} else {
+			cache.local_to_world[i] = cache.local_to_world[parent] * glm::mat4(::make_local_to_parent(transforms, i));
+		}
+		cache.has_world_to_local[i] = 0;
+	}
+}
 
 void Scene::draw(Camera const &camera) const {
-	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	if (!valid(camera.transform)) throw std::runtime_error("Scene::draw called with a camera whose transform was removed.");
+	update_world_matrices();
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(cached_world_to_local(camera.transform));
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
-	draw(world_to_clip, world_to_light);
+	draw_drawables(world_to_clip, world_to_light);
 }
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	update_world_matrices();
+	draw_drawables(world_to_clip, world_to_light);
+}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+//counters for Scene::get_draw_stats() (draw() is only called from the main thread):
+static Scene::DrawStats draw_stats;
+
+Scene::DrawStats Scene::get_draw_stats() {
+	return draw_stats;
+}
+
+void Scene::reset_draw_stats() {
+	draw_stats = DrawStats();
+}
+
+//Tracks the GL state draw_drawables() has set, so binds that wouldn't change anything can be skipped:
+// (other code may change GL state between draw() calls, so this only lives for one call and starts out "unknown")
+struct GLStateCache {
+	static constexpr GLuint Unknown = -1U;
+	GLuint program = Unknown;
+	GLuint vao = Unknown;
+	GLenum active_texture = GL_NONE;
+	struct TextureUnit {
+		GLenum target = GL_NONE; //target something is bound to (GL_NONE: nothing bound by this cache)
+		GLuint texture = 0;
+	} units[Scene::Drawable::Pipeline::TextureCount];
+
+	void use_program(GLuint program_) {
+		if (program == program_) { draw_stats.binds_skipped += 1; return; }
+		program = program_;
+		glUseProgram(program);
+		draw_stats.binds += 1;
+	}
+	void bind_vertex_array(GLuint vao_) {
+		if (vao == vao_) { draw_stats.binds_skipped += 1; return; }
+		vao = vao_;
+		glBindVertexArray(vao);
+		draw_stats.binds += 1;
+	}
+	//bind 'texture' (or nothing, if zero) to 'target' on texture unit 'unit':
+	void bind_texture(uint32_t unit, GLenum target, GLuint texture) {
+		TextureUnit &u = units[unit];
+		if (texture == 0 && u.target == GL_NONE) return; //(nothing wanted, nothing bound -- not a bind at all)
+		if (u.target == target && u.texture == texture) {
+			draw_stats.binds_skipped += 1;
+			return;
+		}
+		if (active_texture != GL_TEXTURE0 + unit) {
+			active_texture = GL_TEXTURE0 + unit;
+			glActiveTexture(active_texture);
+		}
+		//clear the old binding if it was to a different target (so unbinding later only needs to look at one target):
+		if (u.target != GL_NONE && (texture == 0 || u.target != target)) {
+			glBindTexture(u.target, 0);
+			u.target = GL_NONE;
+			u.texture = 0;
+		}
+		if (texture != 0) {
+			glBindTexture(target, texture);
+			u.target = target;
+			u.texture = texture;
+		}
+		draw_stats.binds += 1;
+	}
+	//leave things as draw() always has: no textures bound, texture unit zero active, no program or vertex array:
+	void reset() {
+		for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+			bind_texture(i, GL_NONE, 0);
+		}
+		if (active_texture != GL_TEXTURE0) glActiveTexture(GL_TEXTURE0);
+		active_texture = GL_TEXTURE0;
+		if (program != 0) glUseProgram(0);
+		if (vao != 0) glBindVertexArray(0);
+		program = 0;
+		vao = 0;
+	}
+};
+
+void Scene::draw_drawables(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+
+	//Build a list of drawables to draw, sorted so that drawables sharing a program / vertex array / textures end up adjacent:
+	// (stable, so drawables with the same state keep the order they were added in)
+	draw_list.clear();
+	for (uint32_t i = 0; i < uint32_t(drawables.size()); ++i) {
+		Scene::Drawable::Pipeline const &pipeline = drawables[i].pipeline;
 
 		//skip any drawables without a shader program set:
 		if (pipeline.program == 0) continue;
@@ -100,23 +379,49 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		if (pipeline.vao == 0) continue;
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
+		//skip any drawables whose transform has been removed:
+		if (!valid(drawables[i].transform)) continue;
+
+		DrawListEntry entry;
+		entry.program = pipeline.program;
+		entry.vao = pipeline.vao;
+		for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+			entry.textures[t] = pipeline.textures[t].texture;
+		}
+		entry.drawable = i;
+		draw_list.emplace_back(entry);
+	}
+	std::stable_sort(draw_list.begin(), draw_list.end(), [](DrawListEntry const &a, DrawListEntry const &b) {
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		return std::lexicographical_compare(a.textures, a.textures + Drawable::Pipeline::TextureCount, b.textures, b.textures + Drawable::Pipeline::TextureCount);
+	});
 
+	GLStateCache state;
+
+	//Send each drawable to OpenGL:
+	for (DrawListEntry const &entry : draw_list) {
+		Drawable const &drawable = drawables[entry.drawable];
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		state.use_program(pipeline.program);
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		state.bind_vertex_array(pipeline.vao);
 
 		//Configure program uniforms:
 
 		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		glm::mat4x3 const &object_to_world = cached_local_to_world(drawable.transform); //(drawables *must* have a transform in this scene)
+
+		//stored positions may need dequantizing (compact meshes) before they are in object space:
+		glm::mat4 position_to_world = glm::mat4(object_to_world) * glm::mat4(pipeline.position_to_object);
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+			glm::mat4 object_to_clip = world_to_clip * position_to_world;
 			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
 		}
 
@@ -125,7 +430,8 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 		//OBJECT_TO_CLIP takes vertices from object space to light space:
 		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			glm::mat4x3 position_to_light = world_to_light * position_to_world;
+			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(position_to_light));
 		}
 
 		//NORMAL_TO_CLIP takes normals from object space to light space:
@@ -134,40 +440,37 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
+		//OCTAHEDRAL_NORMALS says how to decode the Normal attribute:
+		if (pipeline.OCTAHEDRAL_NORMALS_bool != -1U) {
+			glUniform1i(pipeline.OCTAHEDRAL_NORMALS_bool, pipeline.octahedral_normals ? 1 : 0);
+		}
+
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
 		//set up textures:
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
+			state.bind_texture(i, pipeline.textures[i].target, pipeline.textures[i].texture);
 		}
 
 		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+		if (pipeline.index_type == GL_NONE) {
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		} else {
+			GLuint index_size = (pipeline.index_type == GL_UNSIGNED_BYTE ? 1 : pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			glDrawElements(pipeline.type, pipeline.count, pipeline.index_type, (GLbyte const *)0 + size_t(pipeline.start) * index_size);
 		}
-		glActiveTexture(GL_TEXTURE0);
-
+		draw_stats.draws += 1;
 	}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	state.reset();
 
-	GL_ERRORS();
+	//(no GL_ERRORS() here -- glGetError() can stall the driver; modes check once per frame instead)
 }
 
 
 void Scene::load(std::string const &filename,
-	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	std::function< void(Scene &, Transform, std::string const &) > const &on_drawable) {
 
 	std::ifstream file(filename, std::ios::binary);
 
@@ -221,28 +524,27 @@ void Scene::load(std::string const &filename,
 	//--------------------------------
 	//Now that file is loaded, create transforms for hierarchy entries:
 
-	std::vector< Transform * > hierarchy_transforms;
+	std::vector< Transform > hierarchy_transforms;
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		Transform t = add_transform();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			set_parent(t, hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			name(t) = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		position(t) = h.position;
+		rotation(t) = h.rotation;
+		scale(t) = h.scale;
 
 		hierarchy_transforms.emplace_back(t);
 	}
@@ -314,7 +616,7 @@ void Scene::load(std::string const &filename,
 
 //-------------------------
 
-Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform, std::string const &) > const &on_drawable) {
 	load(filename, on_drawable);
 }
 
@@ -327,51 +629,12 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other) {
+	//transforms keep their slots (and generations), so handles need no fixup:
+	transforms = other.transforms;
+	world_cache = other.world_cache;
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
-
-	//Copy transforms and store mapping:
-	transforms.clear();
-	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
-
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
-	}
-
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
-	}
-
-	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
-	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
-	}
-
-	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
-	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
-	}
-
-	//copy other's lights, updating transform pointers:
 	lights = other.lights;
-	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
-	}
 }
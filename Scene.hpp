@@ -1,7 +1,7 @@
 #pragma once
 
 /*
- * A scene manages a hierarchical arrangement of transformations (via "Transform").
+ * A scene manages a hierarchical arrangement of transformations (referred to by "Transform" handles).
  *
  * Each transformation may have associated:
  *  - Drawing data (via "Drawable")
@@ -20,39 +20,25 @@
 #include <functional>
 #include <string>
 #include <vector>
-#include <unordered_map>
 
 struct Scene {
+	//Transforms are stored in parallel arrays (see 'transforms', below) and referred to by handle.
+	// A handle is a slot index plus that slot's generation, so a handle to a removed transform
+	// is detectably invalid rather than dangling:
 	struct Transform {
-		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		uint32_t index = -1U;
+		uint32_t generation = 0;
 
-		//The core function of a transform is to store a transformation in the world:
-		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
-		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
-
-		//The transform above may be relative to some parent transform:
-		Transform *parent = nullptr;
-
-		//It is often convenient to construct matrices representing this transformation:
-		// ..relative to its parent:
-		glm::mat4x3 make_local_to_parent() const;
-		glm::mat4x3 make_parent_to_local() const;
-		// ..relative to the world:
-		glm::mat4x3 make_local_to_world() const;
-		glm::mat4x3 make_world_to_local() const;
-
-		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
-		Transform(Transform const &) = delete;
-		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
-		Transform() = default;
+		//the default-constructed handle refers to no transform (e.g., "no parent"):
+		explicit operator bool() const { return index != -1U; }
+		bool operator==(Transform const &other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(Transform const &other) const { return !(*this == other); }
 	};
 
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
-		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
-		Transform * transform;
+		Drawable(Transform transform_) : transform(transform_) { assert(transform); }
+		Transform transform;
 
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
@@ -61,16 +47,22 @@ struct Scene {
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
 
-			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
-			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
-			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays / glDrawElements
+			GLuint start = 0; //first vertex (or index) to draw
+			GLuint count = 0; //number of vertices (or indices) to draw
+			GLenum index_type = GL_NONE; //GL_NONE to draw with glDrawArrays; otherwise type of indices in vao's element array buffer, passed to glDrawElements
+
+			//vertex decoding (copied from Mesh):
+			glm::mat4x3 position_to_object = glm::mat4x3(1.0f); //dequantizes stored positions; folded into OBJECT_TO_CLIP and OBJECT_TO_LIGHT
+			bool octahedral_normals = false; //passed to OCTAHEDRAL_NORMALS
 
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+			GLuint OCTAHEDRAL_NORMALS_bool = -1U; //uniform location for flag saying Normal holds octahedral coordinates
 
-			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
+			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms (shouldn't change the bound program, vertex array, or textures)
 
 			//texture objects to bind for the first TextureCount textures:
 			enum : uint32_t { TextureCount = 4 };
@@ -83,8 +75,8 @@ struct Scene {
 
 	struct Camera {
 		//a 'Camera' attaches camera data to a transform:
-		Camera(Transform *transform_) : transform(transform_) { assert(transform); }
-		Transform * transform;
+		Camera(Transform transform_) : transform(transform_) { assert(transform); }
+		Transform transform;
 		//NOTE: cameras are directed along their -z axis
 
 		//perspective camera parameters:
@@ -97,8 +89,8 @@ struct Scene {
 
 	struct Light {
 		//a 'Light' attaches light data to a transform:
-		Light(Transform *transform_) : transform(transform_) { assert(transform); }
-		Transform * transform;
+		Light(Transform transform_) : transform(transform_) { assert(transform); }
+		Transform transform;
 		//NOTE: directional, spot, and hemisphere lights are directed along their -z axis
 
 		enum Type : char {
@@ -117,37 +109,149 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
-	std::list< Transform > transforms;
-	std::list< Drawable > drawables;
+	// (drawables are a vector since draw() walks all of them every frame -- adding drawables moves them)
+	std::vector< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Transform data, one entry per slot (slots of removed transforms are reused):
+	struct Transforms {
+		std::vector< std::string > name; //names are useful for debugging and looking up locations in a loaded scene
+		//The core function of a transform is to store a transformation in the world:
+		std::vector< glm::vec3 > position;
+		std::vector< glm::quat > rotation;
+		std::vector< glm::vec3 > scale;
+		//...which may be relative to some parent transform:
+		std::vector< uint32_t > parent; //slot of parent, or -1U (change with set_parent())
+
+		std::vector< uint32_t > generation; //incremented when a slot's transform is removed
+		std::vector< uint8_t > alive;
+		std::vector< uint32_t > free_slots;
+
+		uint32_t size() const { return uint32_t(position.size()); } //(number of slots, including free ones)
+	} transforms;
+
+	//create a transform (at the origin, with no parent):
+	Transform add_transform(std::string const &name = "");
+	//remove a transform (its children become roots):
+	// (drawables, cameras, and lights attached to it are *not* removed -- their handles just go stale;
+	//  draw() skips such drawables and throws if asked to draw from such a camera; check valid() before using the rest)
+	void remove_transform(Transform transform);
+	//does the handle refer to a transform in this scene?
+	bool valid(Transform transform) const;
+	//handle for the transform in a slot (invalid if the slot is free); useful for iterating over all transforms:
+	Transform transform_at(uint32_t index) const;
+	//first transform with a given name (or an invalid handle):
+	Transform find_transform(std::string const &name) const;
+
+	//Transform data by handle:
+	// (references are invalidated by add_transform())
+	std::string &name(Transform transform) { return transforms.name[slot(transform)]; }
+	std::string const &name(Transform transform) const { return transforms.name[slot(transform)]; }
+	glm::vec3 &position(Transform transform) { return transforms.position[slot(transform)]; }
+	glm::vec3 const &position(Transform transform) const { return transforms.position[slot(transform)]; }
+	glm::quat &rotation(Transform transform) { return transforms.rotation[slot(transform)]; }
+	glm::quat const &rotation(Transform transform) const { return transforms.rotation[slot(transform)]; }
+	glm::vec3 &scale(Transform transform) { return transforms.scale[slot(transform)]; }
+	glm::vec3 const &scale(Transform transform) const { return transforms.scale[slot(transform)]; }
+	Transform parent(Transform transform) const { return transform_at(transforms.parent[slot(transform)]); }
+	//(throws if this would make a transform its own ancestor)
+	void set_parent(Transform transform, Transform parent);
+
+	//It is often convenient to construct matrices representing a transformation:
+	// ..relative to its parent:
+	glm::mat4x3 make_local_to_parent(Transform transform) const;
+	glm::mat4x3 make_parent_to_local(Transform transform) const;
+	// ..relative to the world:
+	glm::mat4x3 make_local_to_world(Transform transform) const;
+	glm::mat4x3 make_world_to_local(Transform transform) const;
+
+	//Cached versions of the world matrices, refreshed by update_world_matrices():
+	// (draw() calls that; elsewhere, these are only current if it was called since the last change)
+	glm::mat4x3 const &cached_local_to_world(Transform transform) const;
+	glm::mat4x3 const &cached_world_to_local(Transform transform) const; //(computed on first use after a change)
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (the camera must be one of this scene's cameras; throws if its transform was removed)
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//draw() sorts drawables by program, then vertex array, then textures, and skips binds that wouldn't change GL state.
+	//Counters (summed over all draw() calls, on any scene) to keep an eye on the cost of driver calls:
+	struct DrawStats {
+		uint64_t draws = 0; //glDrawArrays / glDrawElements calls
+		uint64_t binds = 0; //program, vertex array, and texture binds made
+		uint64_t binds_skipped = 0; //...and skipped because the state was already set
+	};
+	static DrawStats get_draw_stats();
+	static void reset_draw_stats();
+
+	//Refresh every transform's cached world matrices in one pass (parents before children):
+	// only transforms whose position/rotation/scale/parent -- or whose parent's world matrix -- changed are recomputed.
+	// (draw() calls this; call it yourself to use cached_* elsewhere)
+	void update_world_matrices() const;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
 	void load(std::string const &filename,
-		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
+		std::function< void(Scene &, Transform, std::string const &) > const &on_drawable = nullptr
 	);
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
 
 	//load a scene:
-	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
+	Scene(std::string const &filename, std::function< void(Scene &, Transform, std::string const &) > const &on_drawable);
 
-	//copy a scene (with proper pointer fixup):
+	//copy a scene:
+	// (transforms keep their slots, so handles into the original also refer to the same transforms in the copy)
 	Scene(Scene const &); //...as a constructor
 	Scene &operator=(Scene const &); //...as scene = scene
-	//... as a set() function that optionally returns the transform->transform mapping:
-	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+	void set(Scene const &); //...as a set() function
+
+	//-- internals ---
+
+	//slot of a transform (which must be valid):
+	uint32_t slot(Transform transform) const {
+		assert(valid(transform) && "Transform handle should refer to a transform in this scene.");
+		return transform.index;
+	}
+
+	//draw drawables using already-updated world matrices:
+	void draw_drawables(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const;
+
+	//per-frame draw list (kept between frames to reuse its storage):
+	struct DrawListEntry {
+		GLuint program;
+		GLuint vao;
+		GLuint textures[Drawable::Pipeline::TextureCount];
+		uint32_t drawable; //index in drawables
+	};
+	mutable std::vector< DrawListEntry > draw_list;
+
+	//World matrix cache, as parallel arrays (sized to transforms.size() by update_world_matrices()):
+	mutable struct WorldCache {
+		//values local_to_world was computed from:
+		std::vector< glm::vec3 > position;
+		std::vector< glm::quat > rotation;
+		std::vector< glm::vec3 > scale;
+		std::vector< uint8_t > stale; //must recompute (new or re-parented)
+		std::vector< uint8_t > changed; //recomputed during the current pass
+		//cached matrices:
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< uint8_t > has_world_to_local;
+		std::vector< glm::mat4x3 > world_to_local;
+
+		//live slots, parents before children:
+		std::vector< uint32_t > order;
+		bool order_stale = true; //set when transforms are added, removed, or re-parented
+		std::vector< uint32_t > stale_slots; //slots to mark stale at the next update
+	} world_cache;
 };
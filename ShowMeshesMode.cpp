@@ -2,6 +2,7 @@
 
 #include "ShowMeshesProgram.hpp"
 #include "DrawLines.hpp"
+#include "gl_errors.hpp"
 
 #include <iostream>
 
@@ -10,16 +11,14 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 
 	//Set up scene:
 	{ //create a single camera:
-		scene.transforms.emplace_back();
-		scene.cameras.emplace_back(&scene.transforms.back());
+		scene.cameras.emplace_back(scene.add_transform("camera"));
 		scene_camera = &scene.cameras.back();
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
 	{ //create a drawable to hold the current mesh:
-		scene.transforms.emplace_back();
-		scene.drawables.emplace_back(&scene.transforms.back());
+		scene.drawables.emplace_back(scene.add_transform("mesh"));
 		scene_drawable = &scene.drawables.back();
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
@@ -28,6 +27,7 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
 	}
 
 	//select first mesh in buffer:
@@ -69,7 +69,7 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 			if (SDL_GetModState() & KMOD_SHIFT) {
 				//shift: pan
 
-				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->rotation);
+				glm::mat3 frame = glm::mat3_cast(scene.rotation(scene_camera->transform));
 				camera.target -= frame[0] * (delta.x * camera.radius) + frame[1] * (delta.y * camera.radius);
 			} else {
 				//no shift: tumble
@@ -104,12 +104,12 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene.rotation(scene_camera->transform) =
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
 	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	scene.position(scene_camera->transform) = camera.target + camera.radius * (scene.rotation(scene_camera->transform) * glm::vec3(0.0f, 0.0f, 1.0f));
+	scene.scale(scene_camera->transform) = glm::vec3(1.0f);
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -123,7 +123,7 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	scene.draw(*scene_camera);
 
 	{ //decorate with some lines:
-		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
+		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene.cached_world_to_local(scene_camera->transform)));
 
 		//axis (unit-length):
 		draw_lines.draw(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::u8vec4(0xff, 0x00, 0x00, 0xff));
@@ -149,6 +149,7 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 			glm::u8vec4(0xff, 0xff, 0xff, 0xff)
 		);
 	}
+	GL_ERRORS();
 }
 
 void ShowMeshesMode::select_prev_mesh() {
@@ -161,6 +162,7 @@ void ShowMeshesMode::select_prev_mesh() {
 		scene_drawable->pipeline.type = f->second.type;
 		scene_drawable->pipeline.start = f->second.start;
 		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.index_type = f->second.index_type;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
@@ -168,6 +170,7 @@ void ShowMeshesMode::select_prev_mesh() {
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -190,6 +193,7 @@ void ShowMeshesMode::select_next_mesh() {
 		scene_drawable->pipeline.type = f->second.type;
 		scene_drawable->pipeline.start = f->second.start;
 		scene_drawable->pipeline.count = f->second.count;
+		scene_drawable->pipeline.index_type = f->second.index_type;
 		current_mesh_min = f->second.min;
 		current_mesh_max = f->second.max;
 	} else {
@@ -197,6 +201,7 @@ void ShowMeshesMode::select_next_mesh() {
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = GL_NONE;
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -1,5 +1,6 @@
 #include "ShowSceneMode.hpp"
 #include "DrawLines.hpp"
+#include "gl_errors.hpp"
 
 #include <iostream>
 
@@ -7,8 +8,7 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 
 	//Set up camera-only scene:
 	{ //create a single camera:
-		camera_scene.transforms.emplace_back();
-		camera_scene.cameras.emplace_back(&camera_scene.transforms.back());
+		camera_scene.cameras.emplace_back(camera_scene.add_transform("camera"));
 		scene_camera = &camera_scene.cameras.back();
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
@@ -40,7 +40,7 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			if (SDL_GetModState() & KMOD_SHIFT) {
 				//shift: pan
 
-				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->rotation);
+				glm::mat3 frame = glm::mat3_cast(camera_scene.rotation(scene_camera->transform));
 				camera.target -= frame[0] * (delta.x * camera.radius) + frame[1] * (delta.y * camera.radius);
 			} else {
 				//no shift: tumble
@@ -75,12 +75,12 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	camera_scene.rotation(scene_camera->transform) =
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
 	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	camera_scene.position(scene_camera->transform) = camera.target + camera.radius * (camera_scene.rotation(scene_camera->transform) * glm::vec3(0.0f, 0.0f, 1.0f));
+	camera_scene.scale(scene_camera->transform) = glm::vec3(1.0f);
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -91,12 +91,16 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 
-	scene.draw(*scene_camera);
+	//(the camera lives in camera_scene, so build the projection here rather than using scene.draw(*scene_camera))
+	glm::mat4 world_to_clip = scene_camera->make_projection() * glm::mat4(camera_scene.make_world_to_local(scene_camera->transform));
+	scene.draw(world_to_clip);
 
-	{ //decorate with some lines:
-		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
-		for (auto &transform : scene.transforms) {
-			glm::mat4 local_to_world = transform.make_local_to_world();
+	{ //decorate with some lines (scene.draw() just brought the cached matrices up to date):
+		DrawLines draw_lines(world_to_clip);
+		for (uint32_t i = 0; i < scene.transforms.size(); ++i) {
+			Scene::Transform transform = scene.transform_at(i);
+			if (!transform) continue;
+			glm::mat4 local_to_world = glm::mat4(scene.cached_local_to_world(transform));
 			auto xf = [&local_to_world](glm::vec3 const &vec) {
 				return glm::vec3(local_to_world * glm::vec4(vec, 1.0f));
 			};
@@ -104,9 +108,9 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 				return glm::vec3(local_to_world * glm::vec4(vec, 0.0f));
 			};
 
-			if (transform.parent) {
+			if (Scene::Transform parent = scene.parent(transform)) {
 				//connect to parent:
-				glm::vec3 p = glm::vec3(transform.parent->make_local_to_world()[3]);
+				glm::vec3 p = glm::vec3(scene.cached_local_to_world(parent)[3]);
 				draw_lines.draw(p, xf(glm::vec3(0.0f)), glm::u8vec4(0xff, 0xff, 0x00, 0xff));
 			}
 
@@ -121,7 +125,7 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 			draw_lines.draw(xf(glm::vec3(0.0f)), xf(glm::vec3(0.0f, 0.0f, -len)), glm::u8vec4(0x00, 0x00, 0x88, 0xff));
 
 			//transform name:
-			draw_lines.draw_text("'" + transform.name + "'",
+			draw_lines.draw_text("'" + scene.name(transform) + "'",
 				xf(glm::vec3(0.05f, 0.0f, 0.05f)),
 				0.15f * xfd(glm::vec3(1.0f, 0.0f, 0.0f)),
 				0.15f * xfd(glm::vec3(0.0f, 0.0f, 1.0f)),
@@ -135,5 +139,5 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		*/
 	}
-
+	GL_ERRORS();
 }
@@ -1,15 +1,19 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "pcm_cache.hpp"
+#include "synth_kernels.hpp"
+#include "spsc_queue.hpp"
+#include "opus_stream.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <atomic>
 #include <cassert>
 #include <exception>
 #include <iostream>
 #include <algorithm>
-#include <random>
+#include <chrono>
 
 //local (to this file) data used by the audio system:
 namespace {
@@ -18,30 +22,164 @@ namespace {
 	uint64_t crackle_duration = 0;
 	uint64_t global_sample = 0;
 	float crackle_amount = 0.0f;
+	//seed for the voice and crackle noise streams (see Sound::set_seed()):
+	uint32_t noise_seed = 0x5eed;
+	//crackle effect gets its own noise stream:
+	uint32_t crackle_seed = noise_hash(0x5eed, 0xc7ac41e5);
+	uint32_t crackle_counter = 0;
+	std::vector<float> crackle_noise;
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MAX_MIX_SAMPLES = 1024; //the mixer works in chunks of at most this many samples (callbacks of any length are split up)
 
-	//The audio device:
+	//The audio device, and the callback length it granted:
 	SDL_AudioDeviceID device = 0;
-
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	uint32_t buffer_samples = 0;
+
+	//set once something (the audio device or Sound::mix()) will be draining the command queue:
+	bool mixer_running = false; //(game thread)
+
+	//band-limited single-cycle wavetables for OSC_SQUARE, OSC_SAW, and OSC_SINE:
+	// level L contains only the harmonics that stay under Nyquist for notes up to WAVETABLE_BASE * 2^L Hz.
+	// each table has one extra guard sample (a copy of the first) so lookups can lerp without wrapping.
+	constexpr uint32_t WAVETABLE_BITS = 11;
+	constexpr uint32_t WAVETABLE_SIZE = 1 << WAVETABLE_BITS;
+	constexpr uint32_t WAVETABLE_LEVELS = 11;
+	constexpr float WAVETABLE_BASE = 20.0f;
+	constexpr uint32_t WAVETABLE_FRAC_BITS = 32 - WAVETABLE_BITS;
+	float wavetables[3][WAVETABLE_LEVELS][WAVETABLE_SIZE + 1];
+
+	//playing samples live in a fixed table of slots; a Sound::PlayingSample handle names a slot and the generation it was handed out in.
+	// the game thread fills a free slot and sends PLAY_SAMPLE; when the sample is done, the audio thread bumps the slot's
+	// generation (so old handles go stale) and returns the slot through free_sample_slots -- no allocation or locking either way.
+	struct SampleSlot {
+		float const *data = nullptr; //sample data being played
+		uint32_t size = 0;
+		OpusStream *stream = nullptr; //...or the stream it comes from (owned by the slot; deleted on the game thread once the slot is free)
+		uint32_t i = 0; //next data value to read
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		bool in_use = false; //handed out and not finished yet (set by the game thread, cleared by the audio thread)
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		std::atomic< uint32_t > generation{0};
+	};
+	constexpr uint32_t MAX_PLAYING_SAMPLES = 256;
+	SampleSlot sample_slots[MAX_PLAYING_SAMPLES];
+	//free slots, from the audio thread back to the game thread...
+	SPSCQueue< uint32_t, MAX_PLAYING_SAMPLES > free_sample_slots;
+	//...which keeps a stack of the ones it has picked up (or never handed out) -- see take_free_slots():
+	uint32_t spare_sample_slots[MAX_PLAYING_SAMPLES];
+	uint32_t spare_sample_slot_count = 0; //(game thread)
+	bool sample_slots_initialized = false; //(game thread)
+	//the slots the audio thread is mixing (audio thread only):
+	uint32_t active_samples[MAX_PLAYING_SAMPLES];
+	uint32_t active_sample_count = 0;
+
+	//preallocated voice pool, carved up into per-instrument blocks by add_instrument():
+	Sound::GlitchSynth voices[Sound::MAX_VOICES];
+	uint32_t voices_used = 0; //(only touched by the game thread)
+
+	//add_instrument() fills in instruments[instrument_count] and then publishes it by bumping instrument_count,
+	// so the audio thread never sees a half-written instrument:
+	Sound::Instrument instruments[Sound::MAX_INSTRUMENTS];
+	std::atomic< uint32_t > instrument_count(0);
+
+	//incremented on every note on; used to find the oldest voice:
+	uint64_t note_counter = 0;
+
+	//sequences installed by play_sequences(), along with their timing:
+	struct SequencePlayer {
+		std::vector< Sound::Sequence > sequences;
+		double samples_per_step = 0.0;
+		float swing = 0.0f;
+		uint64_t start_time = 0; //sample time of step 0
+		uint64_t step = 0; //next step to play
+		uint64_t next_time = 0; //sample time of 'step'
+	};
+	//the audio thread plays (at most) one; the game thread owns them all, freeing them only once the audio thread is done:
+	SequencePlayer *sequence_player = nullptr; //(audio thread)
+	std::vector< std::unique_ptr< SequencePlayer > > sequence_players; //(game thread)
+	//players the audio thread has let go of (replaced or stopped), back to the game thread to free -- see free_sequence_players():
+	// (if this ever fills, the player just stays in sequence_players until the next clear)
+	SPSCQueue< SequencePlayer *, 1024 > done_sequence_players;
+
+	//note-ons reported by sequences, from the audio thread to the game thread:
+	SPSCQueue< Sound::SequenceEvent, 256 > sequence_events;
+
+	//synth control goes from the game thread to the audio thread through this queue (never via lock()):
+	struct Command {
+		enum : uint8_t {
+			NOTE_ON,
+			NOTE_OFF,
+			SET_PARAM,
+			PLAY_SEQUENCES,
+			STOP_SEQUENCES,
+			CLEAR_INSTRUMENTS,
+			PLAY_SAMPLE
+		} type = NOTE_ON;
+		uint8_t param = 0; //(Sound::Param, for SET_PARAM)
+		int32_t instrument = -1;
+		int32_t note = 0;
+		float value = 0.0f; //frequency or parameter value
+		uint64_t time = 0; //sample time at which to apply; anything in the past means "right away"
+		SequencePlayer *player = nullptr; //(for PLAY_SEQUENCES)
+		uint32_t slot = 0; //(for PLAY_SAMPLE)
+	};
+	SPSCQueue< Command, 1024 > commands;
+
+	//commands drained from the queue but not yet due; kept sorted by time (audio thread only):
+	constexpr uint32_t MAX_PENDING = 256;
+	Command pending[MAX_PENDING];
+	uint32_t pending_count = 0;
+
+	//number of samples mixed so far (the clock command times refer to):
+	std::atomic< uint64_t > sample_time(0);
+
+	//CLEAR_INSTRUMENTS handshake: the audio thread publishes clears_applied as clears_done at the end of each callback:
+	std::atomic< uint32_t > clears_done(0);
+	uint32_t clears_applied = 0; //(audio thread)
+	uint32_t clears_sent = 0; //(game thread)
+
+	//callback timing (see Sound::get_callback_stats()); each counter has one writer and is read with relaxed loads,
+	// so a snapshot may mix two callbacks' worth of numbers, but nothing ever blocks:
+	struct CallbackTiming {
+		std::atomic< uint64_t > histogram[Sound::CallbackStats::LOAD_BUCKETS + 1];
+		std::atomic< uint64_t > callbacks;
+		std::atomic< uint64_t > busy_ns; //total time spent in the callback...
+		std::atomic< uint64_t > period_ns; //...and total time the callbacks' buffers play for
+		std::atomic< uint64_t > peak_ns;
+		std::atomic< uint64_t > last_period_ns;
+		std::atomic< uint32_t > peak_load_ppm; //(millionths of a period)
+		//written by lock() (game thread):
+		std::atomic< uint64_t > locks;
+		std::atomic< uint64_t > contended_locks;
+		std::atomic< uint64_t > peak_lock_wait_ns;
+	} timing;
+	//set while the callback is running, so lock() can tell that it is about to wait:
+	std::atomic< bool > in_callback(false);
 
 }
 
-// TODO: use a nicer shared pointers impl
-Sound::GlitchSynth synths[Sound::NUM_SYNTHS];
-
-void Sound::GlitchSynth::set_attack(float amp, uint64_t at) {
+void Sound::GlitchSynth::set_attack(float amp, uint64_t at, Curve curve) {
 	attack_amplitude = amp;
 	attack_threshold = at;
+	attack_curve = curve;
 }
 
-void Sound::GlitchSynth::set_decay(float amp, uint64_t at) {
+void Sound::GlitchSynth::set_decay(float amp, uint64_t at, Curve curve) {
 	decay_amplitude = amp;
 	decay_threshold = at;
+	decay_curve = curve;
 }
 
 // sustain doesn't have a time because it's held as long as the player holds a key down
@@ -49,116 +187,285 @@ void Sound::GlitchSynth::set_sustain(float amp) {
 	sustain_amplitude = amp;
 }
 
-void Sound::GlitchSynth::set_release(float amp, uint64_t at) {
+void Sound::GlitchSynth::set_release(float amp, uint64_t at, Curve curve) {
 	release_amplitude = amp;
 	release_threshold = at;
+	release_curve = curve;
+}
+
+void Sound::GlitchSynth::begin_segment(float target, uint64_t length, Curve curve) {
+	env_target = target;
+	env_left = length;
+	env_curve = curve;
+	if (length == 0) {
+		//nothing to ramp; end_segment() will snap to target
+		env_step = 0.0f;
+	} else if (curve == CURVE_LINEAR) {
+		env_step = (target - env_level) / float(length);
+	} else {
+		//exponential: aim a little past the target so the curve actually arrives in 'length' samples
+		// (smaller overshoot == snappier curve)
+		constexpr float OVERSHOOT = 0.01f;
+		env_goal = target + (target - env_level) * OVERSHOOT;
+		env_mul = float(std::pow(OVERSHOOT / (1.0 + OVERSHOOT), 1.0 / double(length)));
+	}
+}
+
+void Sound::GlitchSynth::end_segment() {
+	//snap to the target so rounding doesn't accumulate from segment to segment:
+	env_level = env_target;
+
+	switch (adsr_state) {
+		case ADSR_ATTACK:
+			adsr_state = ADSR_DECAY;
+			begin_segment(decay_amplitude, decay_threshold, decay_curve);
+			break;
+
+		case ADSR_DECAY:
+			// hold at sustain_amplitude till key is released
+			adsr_state = ADSR_SUSTAIN;
+			env_level = sustain_amplitude;
+			begin_segment(sustain_amplitude, std::numeric_limits< uint64_t >::max(), CURVE_LINEAR);
+			break;
+
+		case ADSR_RELEASE:
+		case ADSR_SUSTAIN:
+		case ADSR_END:
+		default:
+			// note is over; hold release_amplitude and hand the voice back to the allocator
+			adsr_state = ADSR_END;
+			is_on = false;
+			begin_segment(release_amplitude, std::numeric_limits< uint64_t >::max(), CURVE_LINEAR);
+			break;
+	}
+}
+
+// fill wavetables by additive synthesis from the Fourier series of each (naive) shape
+// (this is the same shape the old per-sample code computed, just without the aliasing)
+void init_wavetables() {
+	constexpr float PI = 3.14159265358979f;
+
+	std::vector< float > sine(WAVETABLE_SIZE);
+	for (uint32_t i = 0; i < WAVETABLE_SIZE; ++i) {
+		sine[i] = float(std::sin(2.0 * 3.14159265358979 * i / double(WAVETABLE_SIZE)));
+	}
+	//cos(x) == sin(x + 1/4 cycle):
+	auto cosine = [&](uint32_t i) { return sine[(i + WAVETABLE_SIZE / 4) & (WAVETABLE_SIZE - 1)]; };
+
+	for (uint32_t level = 0; level < WAVETABLE_LEVELS; ++level) {
+		float max_frequency = WAVETABLE_BASE * float(1 << level);
+		uint32_t harmonics = uint32_t((AUDIO_RATE / 2) / max_frequency);
+		harmonics = std::max(1U, std::min(WAVETABLE_SIZE / 2 - 1, harmonics));
+
+		float *square = wavetables[Sound::GlitchSynth::OSC_SQUARE][level];
+		float *saw = wavetables[Sound::GlitchSynth::OSC_SAW][level];
+		float *arch = wavetables[Sound::GlitchSynth::OSC_SINE][level];
+
+		for (uint32_t i = 0; i < WAVETABLE_SIZE; ++i) {
+			//square: +1 for the first half cycle, -1 for the second
+			//saw: from -1 to +1 over a cycle
+			//sine: 2 * sin(pi * t) - 1
+			float sq = 0.0f;
+			float sw = 0.0f;
+			float ar = 0.0f;
+			for (uint32_t k = 1; k <= harmonics; ++k) {
+				uint32_t idx = (k * i) & (WAVETABLE_SIZE - 1);
+				if (k & 1) sq += sine[idx] / float(k);
+				sw += sine[idx] / float(k);
+				ar += cosine(idx) / float(4 * k * k - 1);
+			}
+			square[i] = (4.0f / PI) * sq;
+			saw[i] = -(2.0f / PI) * sw;
+			arch[i] = (4.0f / PI - 1.0f) - (8.0f / PI) * ar;
+		}
+		square[WAVETABLE_SIZE] = square[0];
+		saw[WAVETABLE_SIZE] = saw[0];
+		arch[WAVETABLE_SIZE] = arch[0];
+	}
 }
 
-// stop current note, setup for playing new note
-// TODO: find cause of ADSR not following smoothly
+// setup for playing new note
+// the oscillator phase and envelope level carry on from whatever this voice was doing, so retriggering doesn't click
 void Sound::GlitchSynth::play(float frequency) {
-	cycle_length = uint64_t(AUDIO_RATE/frequency);
-	current_sample_number = 0;
-	release_start = 0;
+	phase_step = uint32_t(double(frequency) / AUDIO_RATE * 4294967296.0);
+
+	//pick the lowest mip level that is band-limited enough for this frequency:
+	wavetable_level = 0;
+	while (wavetable_level + 1 < WAVETABLE_LEVELS && WAVETABLE_BASE * float(1 << wavetable_level) < frequency) {
+		wavetable_level += 1;
+	}
+
+	update_filter();
+
 	adsr_state = ADSR_ATTACK;
 	do_release = false;
+	begin_segment(attack_amplitude, attack_threshold, attack_curve);
+}
+
+void Sound::GlitchSynth::update_filter() {
+	if (filter == FILTER_OFF) {
+		svf = SvfCoefficients();
+	} else {
+		SvfMode mode = (filter == FILTER_LOWPASS ? SVF_LOWPASS : filter == FILTER_BANDPASS ? SVF_BANDPASS : SVF_HIGHPASS);
+		svf = svf_coefficients(mode, filter_cutoff / float(AUDIO_RATE), filter_resonance);
+	}
 }
 
 // add own samples to given buffer
 void Sound::GlitchSynth::generate_samples(int n, std::vector<float>& buffer) {
-	int half_cycle = int(cycle_length/2);
-	uint64_t ad_threshold = attack_threshold + decay_threshold;
-	static std::mt19937 mt;
+	float const *table = (osc == OSC_NOISE ? nullptr : wavetables[osc][wavetable_level]);
 
 	for (int i = 0; i < n; i++) {
-		int cycle_position = int(current_sample_number % cycle_length);
 		float s = 0;
 		switch (osc) {
-			case OSC_SQUARE: // +1 for half cycle, -1 for other half
-				// o p t i m i z e d
-				s = float((cycle_position <= half_cycle) - (cycle_position > half_cycle));
+			case OSC_SQUARE:
+			case OSC_SAW:
+			case OSC_SINE: { // wavetable lookup + lerp
+				uint32_t index = phase >> WAVETABLE_FRAC_BITS;
+				float frac = float(phase & ((1U << WAVETABLE_FRAC_BITS) - 1)) * (1.0f / float(1U << WAVETABLE_FRAC_BITS));
+				s = table[index] + (table[index+1] - table[index]) * frac;
 				break;
+			}
 
-			case OSC_SAW: // from -1 to +1 over a cycle
-				s = (2.0f * cycle_position/float(cycle_length)) - 1.0f;
+			case OSC_NOISE:
+				render_noise(1, &s);
 				break;
+		}
 
-			case OSC_SINE: // standard sine
-				s = 2.0f * std::sinf(3.1415926f * (cycle_position/float(cycle_length))) - 1.0f;
-				break;
+		if (filter != FILTER_OFF) {
+			SvfCoefficients const *coefficients = &svf;
+			float *state = svf_state;
+			float *io = &s;
+			kernel_svf(1, &coefficients, &state, &io, 1);
+		}
 
-			case OSC_NOISE: // uniform noise. TODO: use noise with a peaked distribution
-				s = 2.0f * (mt()/float(mt.max())) - 1.0f;
-				break;
+		// run ADSR envelope
+		if (do_release && (adsr_state == ADSR_ATTACK || adsr_state == ADSR_DECAY || adsr_state == ADSR_SUSTAIN)) {
+			adsr_state = ADSR_RELEASE;
+			begin_segment(release_amplitude, release_threshold, release_curve);
+			do_release = false;
+		}
+		while (env_left == 0) {
+			end_segment();
 		}
+		float amp = env_level;
+		if (env_curve == CURVE_EXPONENTIAL) {
+			env_level = env_goal + (env_level - env_goal) * env_mul;
+		} else {
+			env_level += env_step;
+		}
+		env_left -= 1;
 
-		float amp = 0.0f;
-		float t = 0;
+		buffer[i] += s * volume * amp;
+		phase += phase_step;
+	}
+}
 
-		// run ADSR envelope
-		switch(adsr_state) {
-			case ADSR_ATTACK:
-				// interpolate from 0 to attack_amplitude
-				amp = attack_amplitude * (current_sample_number/float(attack_threshold));
-				if ((current_sample_number + 1) > attack_threshold) {
-					adsr_state = ADSR_DECAY;
-				}
-				// need to be able to execute a release ASAP
-				else if (do_release) {
-					adsr_state = ADSR_RELEASE;
-					release_start = current_sample_number;
-					do_release = false;
-				}
-				break;
-			
-			case ADSR_DECAY:
-				// interpolate from attack_amplitude to decay_amplitude
-				t = (current_sample_number - attack_threshold) / float(decay_threshold);
-				amp = attack_amplitude * (1.0f - t) + decay_amplitude * t;
-				if ((current_sample_number + 1) > ad_threshold) {
-					adsr_state = ADSR_SUSTAIN;
-				}
-				else if (do_release) {
-					adsr_state = ADSR_RELEASE;
-					release_start = current_sample_number;
-					do_release = false;
-				}
-				break;
+// oscillator stage of the block renderer:
+void Sound::GlitchSynth::render_oscillator(uint32_t n, float *out) {
+	assert(n <= BLOCK_SIZE);
+	switch (osc) {
+		case OSC_SQUARE:
+		case OSC_SAW:
+		case OSC_SINE:
+			kernel_wavetable(wavetables[osc][wavetable_level], WAVETABLE_FRAC_BITS, &phase, phase_step, n, out);
+			break;
+
+		case OSC_NOISE:
+			render_noise(n, out);
+			phase += phase_step * n;
+			break;
+	}
+}
 
-			case ADSR_SUSTAIN:
-				// hold at sustain_amplitude till key is released
-				if (do_release) {
-					adsr_state = ADSR_RELEASE;
-					release_start = current_sample_number;
-					do_release = false;
-				}
-				amp = sustain_amplitude;
-				break;
+void Sound::GlitchSynth::render_noise(uint32_t n, float *out) {
+	switch (noise_shape) {
+		case NOISE_UNIFORM:
+			kernel_noise_uniform(noise_seed, noise_counter, n, out);
+			break;
+		case NOISE_TRIANGULAR:
+			kernel_noise_triangular(noise_seed, noise_counter, n, out);
+			break;
+		case NOISE_PINK:
+			kernel_noise_uniform(noise_seed, noise_counter, n, out);
+			kernel_pink_filter(pink_state, n, out);
+			break;
+	}
+	noise_counter += n;
+}
 
-			case ADSR_RELEASE:
-				// interpolate from sustain_amplitude to release_amplitude
-				t = (current_sample_number - release_start) / float(release_threshold);
-				amp = sustain_amplitude * (1.0f - t) + release_amplitude * t;
-				if ((current_sample_number + 1) > (release_start + release_threshold)) {
-					adsr_state = ADSR_END;
-				}
-				break;
+// envelope stage of the block renderer:
+// works out where the segment boundaries fall in this run of samples and fills each segment with a closed-form ramp
+void Sound::GlitchSynth::render_envelope(uint32_t n, float *out) {
+	assert(n <= BLOCK_SIZE);
+
+	// do_release only changes between callbacks, so it only needs to be checked once per run
+	// (the release starts from wherever the envelope currently is)
+	if (do_release && (adsr_state == ADSR_ATTACK || adsr_state == ADSR_DECAY || adsr_state == ADSR_SUSTAIN)) {
+		adsr_state = ADSR_RELEASE;
+		begin_segment(release_amplitude, release_threshold, release_curve);
+		do_release = false;
+	}
 
-			case ADSR_END:
-				// hold release_amplitude
-				amp = release_amplitude;
-				break;
+	uint32_t i = 0;
+	while (i < n) {
+		if (env_left == 0) {
+			end_segment();
+			continue;
+		}
+		uint32_t count = uint32_t(std::min< uint64_t >(n - i, env_left));
+		if (env_curve == CURVE_EXPONENTIAL) {
+			env_level = kernel_exponential_ramp(env_level, env_goal, env_mul, count, out + i);
+		} else {
+			env_level = kernel_linear_ramp(env_level, env_step, count, out + i);
+		}
+		env_left -= count;
+		i += count;
+	}
+}
+
+void Sound::GlitchSynth::render(uint32_t n, float *out) {
+	GlitchSynth *self = this;
+	render_group(&self, 1, n, out);
+}
+
+void Sound::GlitchSynth::render_group(GlitchSynth *const *group, uint32_t count, uint32_t n, float *out) {
+	assert(count <= SVF_LANES);
+	float osc_block[SVF_LANES][BLOCK_SIZE];
+	float env_block[BLOCK_SIZE];
+
+	SvfCoefficients const *coefficients[SVF_LANES];
+	float *state[SVF_LANES];
+	float *io[SVF_LANES];
+	bool filtered = false;
+	for (uint32_t l = 0; l < count; ++l) {
+		coefficients[l] = &group[l]->svf;
+		state[l] = group[l]->svf_state;
+		io[l] = osc_block[l];
+		filtered = filtered || (group[l]->filter != FILTER_OFF);
+	}
 
-			default:
-				amp = 0.0f;
+	for (uint32_t begin = 0; begin < n; begin += BLOCK_SIZE) {
+		bool any_on = false;
+		for (uint32_t l = 0; l < count; ++l) {
+			any_on = any_on || group[l]->is_on;
 		}
+		if (!any_on) break;
 
-		buffer[i] += s * volume * amp;
-		current_sample_number++;
+		uint32_t block = std::min(BLOCK_SIZE, n - begin);
+		for (uint32_t l = 0; l < count; ++l) {
+			group[l]->render_oscillator(block, osc_block[l]);
+		}
+		if (filtered) {
+			kernel_svf(count, coefficients, state, io, block);
+		}
+		for (uint32_t l = 0; l < count; ++l) {
+			group[l]->render_envelope(block, env_block);
+			kernel_mul_add(osc_block[l], group[l]->volume, env_block, block, out + begin);
+		}
 	}
 }
 
-
 //public-facing data:
 
 //global volume control:
@@ -170,33 +477,62 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//Audio-thread side of the command queue; also defined below:
+void apply_command(Command const &command, uint64_t now);
+void drain_commands(uint64_t now);
+
+//Game-thread side of sample playback; defined below:
+Sound::PlayingSample start_sample(float const *data, uint32_t size, std::unique_ptr< OpusStream > stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop);
+
 //------------------------ public-facing --------------------------------
 
 Sound::Sample::Sample(std::string const &filename) {
+	if (map_cached_pcm(filename, &mapped, &data, &size)) return;
+
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+		load_wav(filename, &buffer);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		load_opus(filename, &buffer);
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
+	save_cached_pcm(filename, buffer);
+	data = buffer.data();
+	size = buffer.size();
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::vector< float > const &data_) : buffer(data_) {
+	data = buffer.data();
+	size = buffer.size();
 }
 
 
 
 
 void Sound::lock() {
-	if (device) SDL_LockAudioDevice(device);
+	if (!device) return;
+	bool contended = in_callback.load(std::memory_order_relaxed);
+	auto before = std::chrono::steady_clock::now();
+	SDL_LockAudioDevice(device);
+	uint64_t waited = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - before).count());
+	//(waits much longer than an uncontended mutex takes also count, since the callback may have started in between)
+	if (waited > 50000) contended = true;
+
+	//(the device lock is held, so these read-modify-writes don't race with other lock() callers)
+	timing.locks.store(timing.locks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (contended) timing.contended_locks.store(timing.contended_locks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (waited > timing.peak_lock_wait_ns.load(std::memory_order_relaxed)) timing.peak_lock_wait_ns.store(waited, std::memory_order_relaxed);
 }
 
 void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-void Sound::init() {
+void Sound::init(uint32_t buffer_samples_) {
+	if (!(buffer_samples_ == 128 || buffer_samples_ == 256 || buffer_samples_ == 512 || buffer_samples_ == 1024)) {
+		throw std::runtime_error("Sound::init() buffer size must be 128, 256, 512, or 1024 samples (not " + std::to_string(buffer_samples_) + ").");
+	}
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -209,77 +545,329 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = uint16_t(buffer_samples_);
 	want.callback = mix_audio;
 
-	mix_buffer.reserve(MIX_SAMPLES);
-	crackle_duration = 200;
-
-	for (int i = 0; i < Sound::NUM_SYNTHS; i++) {
-		synths[i].is_on = false;
-	}
+	init_offline();
+	mixer_running = false; //(until the device is open)
 	
-	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	//the device may pick a different buffer size (the mixer copes with any callback length):
+	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
+		buffer_samples = have.samples;
 		//start audio playback:
+		mixer_running = true;
 		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (" << buffer_samples << " sample buffer";
+		if (buffer_samples != buffer_samples_) std::cout << "; asked for " << buffer_samples_;
+		std::cout << ")." << std::endl;
+	}
+}
+
+void Sound::init_offline() {
+	mix_buffer.resize(MAX_MIX_SAMPLES);
+	crackle_noise.resize(MAX_MIX_SAMPLES);
+	crackle_duration = 200;
+
+	init_wavetables();
+
+	for (auto &voice : voices) {
+		voice.is_on = false;
 	}
+
+	mixer_running = true;
+}
+
+void Sound::set_seed(uint32_t seed) {
+	noise_seed = seed;
+	crackle_seed = noise_hash(seed, 0xc7ac41e5);
+	crackle_counter = 0;
+}
+
+void Sound::mix(float *out, uint32_t frames) {
+	assert(device == 0 && "Sound::mix() is for offline rendering; the audio device already runs the mixer.");
+	//(the output doesn't depend on how it is split up, so hand it over in callback-sized pieces to keep the timing stats meaningful)
+	while (frames > 0) {
+		uint32_t count = std::min(frames, MAX_MIX_SAMPLES);
+		mix_audio(nullptr, reinterpret_cast< Uint8 * >(out), int(count * 2 * sizeof(float)));
+		out += 2 * count;
+		frames -= count;
+	}
+}
+
+uint32_t Sound::get_buffer_samples() {
+	return buffer_samples;
 }
 
 
 void Sound::shutdown() {
+	if (timing.callbacks.load(std::memory_order_relaxed) > 0) dump_callback_stats();
+
 	if (device != 0) {
 		//stop audio playback:
 		SDL_PauseAudioDevice(device, 1);
 		SDL_CloseAudioDevice(device);
 		device = 0;
 	}
+	mixer_running = false;
+	buffer_samples = 0;
+	//(audio thread is gone, so it's safe to free sequences and samples)
+	SequencePlayer *done;
+	while (done_sequence_players.pop(&done)) { }
+	sequence_players.clear();
+	// (and to take back every sample slot, staling any handles still out there)
+	uint32_t slot;
+	while (free_sample_slots.pop(&slot)) { }
+	for (auto &sample_slot : sample_slots) {
+		if (sample_slot.in_use) {
+			sample_slot.in_use = false;
+			sample_slot.generation.store(sample_slot.generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		delete sample_slot.stream;
+		sample_slot.stream = nullptr;
+	}
+	active_sample_count = 0;
+	sample_slots_initialized = false;
 }
 
+//pick up the slots the audio thread has finished with (and free their streams, which mustn't happen on the audio thread):
+void take_free_slots() {
+	if (!sample_slots_initialized) {
+		for (uint32_t s = 0; s < MAX_PLAYING_SAMPLES; ++s) {
+			spare_sample_slots[s] = MAX_PLAYING_SAMPLES - 1 - s;
+		}
+		spare_sample_slot_count = MAX_PLAYING_SAMPLES;
+		sample_slots_initialized = true;
+	}
+	uint32_t slot;
+	while (free_sample_slots.pop(&slot)) {
+		delete sample_slots[slot].stream;
+		sample_slots[slot].stream = nullptr;
+		spare_sample_slots[spare_sample_slot_count++] = slot;
+	}
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+//fill a free slot and start it playing (via the command queue, so this never waits for the callback):
+// plays 'size' samples of 'data', or (if 'stream' is set) whatever the stream decodes
+Sound::PlayingSample start_sample(float const *data, uint32_t size, std::unique_ptr< OpusStream > stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop) {
+	Sound::PlayingSample handle;
+	if (!mixer_running) return handle;
+
+	take_free_slots();
+	if (spare_sample_slot_count == 0) {
+		std::cerr << "WARNING: too many samples playing; not playing another." << std::endl;
+		return handle;
+	}
+	uint32_t slot = spare_sample_slots[--spare_sample_slot_count];
+
+	//(the audio thread doesn't look at the slot until it gets the command)
+	SampleSlot &sample_slot = sample_slots[slot];
+	sample_slot.data = data;
+	sample_slot.size = size;
+	assert(!sample_slot.stream);
+	sample_slot.i = 0;
+	sample_slot.loop = loop;
+	sample_slot.stopping = false;
+	sample_slot.in_use = true;
+	sample_slot.volume = Sound::Ramp< float >(volume);
+	sample_slot.pan = Sound::Ramp< float >(pan);
+	sample_slot.position = Sound::Ramp< glm::vec3 >(position);
+	sample_slot.half_volume_radius = Sound::Ramp< float >(half_volume_radius);
+	sample_slot.stream = stream.get();
+
+	//(read the generation before the command is sent -- once it is, the sample may finish and its slot be freed at any time)
+	uint32_t generation = sample_slot.generation.load(std::memory_order_relaxed);
+
+	Command command;
+	command.type = Command::PLAY_SAMPLE;
+	command.slot = slot;
+	if (!commands.push(command)) {
+		std::cerr << "WARNING: synth command queue full; not playing sample." << std::endl;
+		sample_slot.in_use = false;
+		sample_slot.stream = nullptr; //('stream' still owns it, so it gets deleted on return)
+		spare_sample_slots[spare_sample_slot_count++] = slot;
+		return handle;
+	}
+	stream.release(); //(the slot owns it now)
+	handle.slot = slot;
+	handle.generation = generation;
+	return handle;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float volume, float pan) {
+	return start_sample(sample.data, uint32_t(sample.size), nullptr, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_sample(sample.data, uint32_t(sample.size), nullptr, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false);
 }
 
+Sound::PlayingSample Sound::loop(Sample const &sample, float volume, float pan) {
+	return start_sample(sample.data, uint32_t(sample.size), nullptr, volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true);
+}
 
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_sample(sample.data, uint32_t(sample.size), nullptr, volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true);
+}
+
+
+int Sound::add_instrument(GlitchSynth const &patch, uint32_t count) {
+	assert(count > 0);
+	uint32_t index = instrument_count.load(std::memory_order_relaxed);
+	if (index >= MAX_INSTRUMENTS || voices_used + count > MAX_VOICES) return -1;
+
+	//the audio thread doesn't look at instruments[index] (or its voices) until instrument_count is bumped:
+	Instrument &instrument = instruments[index];
+	instrument.patch = patch;
+	instrument.patch.is_on = false;
+	instrument.voice_begin = voices_used;
+	instrument.voice_end = voices_used + count;
+	instrument.is_on = false;
+	for (uint32_t v = instrument.voice_begin; v < instrument.voice_end; ++v) {
+		voices[v] = instrument.patch;
+		//every voice gets its own noise stream:
+		voices[v].noise_seed = noise_hash(noise_seed, v);
+		voices[v].noise_counter = 0;
+	}
+	voices_used += count;
+
+	instrument_count.store(index + 1, std::memory_order_release);
+	return int(index);
 }
 
+void Sound::clear_instruments() {
+	Command command;
+	command.type = Command::CLEAR_INSTRUMENTS;
+
+	if (device == 0) {
+		//no audio thread, so nothing else can be reading the queue or the instruments:
+		// (drain first, as the audio thread would, so queued samples still get their slots -- the clear drops the rest)
+		uint64_t now = sample_time.load(std::memory_order_relaxed);
+		drain_commands(now);
+		apply_command(command, now);
+	} else {
+		//wait for the audio thread to let go of the instruments (this is the only place the game thread waits on it):
+		while (!commands.push(command)) SDL_Delay(1);
+		clears_sent += 1;
+		while (clears_done.load(std::memory_order_acquire) != clears_sent) SDL_Delay(1);
+	}
+
+	voices_used = 0;
+	//(the clear also stopped the sequencer, so no sequence players are in use any more)
+	SequencePlayer *done;
+	while (done_sequence_players.pop(&done)) { }
+	sequence_players.clear();
+}
+
+uint64_t Sound::get_sample_time() {
+	return sample_time.load(std::memory_order_relaxed);
+}
+
+void Sound::note_on(int instrument, int note, float frequency, uint64_t when) {
+	Command command;
+	command.type = Command::NOTE_ON;
+	command.instrument = instrument;
+	command.note = note;
+	command.value = frequency;
+	command.time = when;
+	if (mixer_running && !commands.push(command)) {
+		std::cerr << "WARNING: synth command queue full; dropping note_on." << std::endl;
+	}
+}
+
+void Sound::note_off(int instrument, int note, uint64_t when) {
+	Command command;
+	command.type = Command::NOTE_OFF;
+	command.instrument = instrument;
+	command.note = note;
+	command.time = when;
+	if (mixer_running && !commands.push(command)) {
+		std::cerr << "WARNING: synth command queue full; dropping note_off." << std::endl;
+	}
+}
+
+//free the sequence players the audio thread is done with (game thread):
+void free_sequence_players() {
+	SequencePlayer *done;
+	while (done_sequence_players.pop(&done)) {
+		auto f = std::find_if(sequence_players.begin(), sequence_players.end(), [&](std::unique_ptr< SequencePlayer > const &player) {
+			return player.get() == done;
+		});
+		assert(f != sequence_players.end());
+		if (f != sequence_players.end()) sequence_players.erase(f);
+	}
+}
+
+void Sound::play_sequences(std::vector< Sequence > const &sequences, float bpm, float swing, uint32_t steps_per_beat) {
+	assert(bpm > 0.0f && steps_per_beat > 0);
+	if (!mixer_running) return;
+	free_sequence_players();
+	sequence_players.emplace_back(new SequencePlayer);
+	SequencePlayer *player = sequence_players.back().get();
+	player->sequences = sequences;
+	for (auto &sequence : player->sequences) {
+		sequence.current_idx = 0;
+		sequence.playing_note = 0;
+	}
+	player->samples_per_step = std::max(1.0, 60.0 * AUDIO_RATE / (double(bpm) * steps_per_beat));
+	player->swing = std::min(std::max(swing, 0.0f), 0.9f);
+
+	Command command;
+	command.type = Command::PLAY_SEQUENCES;
+	command.player = player;
+	while (!commands.push(command)) SDL_Delay(1);
+}
+
+void Sound::stop_sequences() {
+	free_sequence_players();
+	Command command;
+	command.type = Command::STOP_SEQUENCES;
+	while (mixer_running && !commands.push(command)) SDL_Delay(1);
+}
+
+bool Sound::poll_sequence_event(SequenceEvent *event) {
+	return sequence_events.pop(event);
+}
+
+void Sound::set_param(int instrument, Param param, float value, uint64_t when) {
+	Command command;
+	command.type = Command::SET_PARAM;
+	command.param = uint8_t(param);
+	command.instrument = instrument;
+	command.value = value;
+	command.time = when;
+	if (mixer_running && !commands.push(command)) {
+		std::cerr << "WARNING: synth command queue full; dropping set_param." << std::endl;
+	}
+}
+
+//helper: fade out a slot's sample (call with Sound::lock() held):
+void stop_slot(SampleSlot &sample_slot, float ramp) {
+	if (!sample_slot.stopping) {
+		sample_slot.stopping = true;
+		sample_slot.volume.target = 0.0f;
+		sample_slot.volume.ramp = ramp;
+	} else {
+		sample_slot.volume.ramp = std::min(sample_slot.volume.ramp, ramp);
+	}
+}
+
+Sound::PlayingSample Sound::stream(std::string const &filename, float volume, float pan, bool loop) {
+	if (!mixer_running) return PlayingSample();
+	//(opens the file here, so errors throw on the caller's thread; decoding happens in the background)
+	return start_sample(nullptr, 0, std::make_unique< OpusStream >(filename, loop), volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), loop);
+}
 
 void Sound::stop_all_samples() {
+	take_free_slots();
 	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+	for (auto &sample_slot : sample_slots) {
+		if (sample_slot.in_use) stop_slot(sample_slot, 1.0f / 60.0f);
 	}
 	unlock();
 }
@@ -290,49 +878,115 @@ void Sound::set_volume(float new_volume, float ramp) {
 	unlock();
 }
 
+Sound::CallbackStats Sound::get_callback_stats() {
+	auto get = [](std::atomic< uint64_t > const &counter) {
+		return counter.load(std::memory_order_relaxed);
+	};
+	CallbackStats stats;
+	for (uint32_t b = 0; b <= CallbackStats::LOAD_BUCKETS; ++b) {
+		stats.histogram[b] = get(timing.histogram[b]);
+	}
+	stats.callbacks = get(timing.callbacks);
+	stats.xruns = stats.histogram[CallbackStats::LOAD_BUCKETS];
+	uint64_t period_ns = get(timing.period_ns);
+	if (period_ns > 0) stats.mean_load = float(double(get(timing.busy_ns)) / double(period_ns));
+	stats.peak_load = timing.peak_load_ppm.load(std::memory_order_relaxed) * 1e-6f;
+	stats.peak_ms = get(timing.peak_ns) * 1e-6f;
+	stats.period_ms = get(timing.last_period_ns) * 1e-6f;
+	stats.locks = get(timing.locks);
+	stats.contended_locks = get(timing.contended_locks);
+	stats.peak_lock_wait_ms = get(timing.peak_lock_wait_ns) * 1e-6f;
+	return stats;
+}
+
+void Sound::reset_callback_stats() {
+	//(the callback's own read-modify-writes may race with this; at worst one callback's numbers survive the reset)
+	lock();
+	for (auto &bucket : timing.histogram) bucket.store(0, std::memory_order_relaxed);
+	for (auto counter : {&timing.callbacks, &timing.busy_ns, &timing.period_ns, &timing.peak_ns, &timing.last_period_ns, &timing.locks, &timing.contended_locks, &timing.peak_lock_wait_ns}) {
+		counter->store(0, std::memory_order_relaxed);
+	}
+	timing.peak_load_ppm.store(0, std::memory_order_relaxed);
+	unlock();
+}
+
+void Sound::dump_callback_stats() {
+	CallbackStats stats = get_callback_stats();
+	std::cout << "Audio callback: " << stats.callbacks << " callbacks of " << stats.period_ms << "ms"
+		<< "; mean load " << 100.0f * stats.mean_load << "%, peak load " << 100.0f * stats.peak_load << "% (" << stats.peak_ms << "ms)"
+		<< "; " << stats.xruns << " xruns.\n";
+	//histogram, skipping empty buckets:
+	for (uint32_t b = 0; b <= CallbackStats::LOAD_BUCKETS; ++b) {
+		if (stats.histogram[b] == 0) continue;
+		uint32_t lo = b * 100 / CallbackStats::LOAD_BUCKETS;
+		if (b < CallbackStats::LOAD_BUCKETS) {
+			std::cout << "  " << lo << "-" << (b + 1) * 100 / CallbackStats::LOAD_BUCKETS << "%: ";
+		} else {
+			std::cout << "  xrun: ";
+		}
+		std::cout << stats.histogram[b] << "\n";
+	}
+	std::cout << "Sound::lock(): " << stats.locks << " locks, " << stats.contended_locks << " contended, longest wait " << stats.peak_lock_wait_ms << "ms." << std::endl;
+}
+
 //------------------
 
-void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
+//helper: the slot a handle refers to, or nullptr if the handle is stale
+// (call with Sound::lock() held, so the audio thread can't finish the sample in the meantime):
+SampleSlot *get_slot(Sound::PlayingSample const &handle) {
+	if (handle.slot >= MAX_PLAYING_SAMPLES) return nullptr;
+	SampleSlot &sample_slot = sample_slots[handle.slot];
+	if (sample_slot.generation.load(std::memory_order_acquire) != handle.generation) return nullptr;
+	return &sample_slot;
+}
+
+void Sound::PlayingSample::set_volume(float new_volume, float ramp) const {
 	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
+	SampleSlot *sample_slot = get_slot(*this);
+	if (sample_slot && !sample_slot->stopping) {
+		sample_slot->volume.set(new_volume, ramp);
 	}
 	Sound::unlock();
 }
 
-void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
+void Sound::PlayingSample::set_pan(float new_pan, float ramp) const {
 	Sound::lock();
-	pan.set(new_pan, ramp);
+	SampleSlot *sample_slot = get_slot(*this);
+	if (sample_slot && sample_slot->pan.value == sample_slot->pan.value) { //ignore if not in '2D' mode
+		sample_slot->pan.set(new_pan, ramp);
+	}
 	Sound::unlock();
 }
 
-void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
+void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) const {
 	Sound::lock();
-	position.set(new_position, ramp);
+	SampleSlot *sample_slot = get_slot(*this);
+	if (sample_slot && !(sample_slot->pan.value == sample_slot->pan.value)) { //ignore if not in '3D' mode
+		sample_slot->position.set(new_position, ramp);
+	}
 	Sound::unlock();
 }
 
-void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
+void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) const {
 	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
+	SampleSlot *sample_slot = get_slot(*this);
+	if (sample_slot && !(sample_slot->pan.value == sample_slot->pan.value)) { //ignore if not in '3D' mode
+		sample_slot->half_volume_radius.set(new_radius, ramp);
+	}
 	Sound::unlock();
 }
 
-void Sound::PlayingSample::stop(float ramp) {
+void Sound::PlayingSample::stop(float ramp) const {
 	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
+	SampleSlot *sample_slot = get_slot(*this);
+	if (sample_slot) stop_slot(*sample_slot, ramp);
 	Sound::unlock();
 }
 
+bool Sound::PlayingSample::playing() const {
+	return slot < MAX_PLAYING_SAMPLES && sample_slots[slot].generation.load(std::memory_order_acquire) == generation;
+}
+
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
@@ -393,34 +1047,33 @@ void compute_pan_from_listener_and_position(
 	}
 }
 
-//helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+//helper: ramp updates (by 'step' seconds, the length of the chunk being mixed)...
 
 //helper: ...for single values:
-void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_value_ramp(Sound::Ramp< float > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (step / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= step;
 	}
 }
 
 //helper: ...for 3D positions:
-void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, step / ramp.ramp);
+		ramp.ramp -= step;
 	}
 }
 
 //helper: ...for 3D directions:
-void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp, float step) {
+	if (ramp.ramp < step) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -444,106 +1097,483 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - step) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= step;
 	}
 }
 
 
-//The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
-	assert(buffer_); //should always have some audio buffer
-	
-	// for crackle effect
-	static std::mt19937 mt;
+//------------------ audio thread ------------------
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
-	LR *buffer = reinterpret_cast< LR * >(buffer_);
+//start a note on an instrument's best voice (free > quietest releasing > oldest) at sample time 'now':
+void start_note(Sound::Instrument &instrument, int note, float frequency, uint64_t now) {
+	using Sound::GlitchSynth;
 
-	int on_counter = 0;
+	uint32_t best = instrument.voice_begin;
+	int best_rank = -1;
+	for (uint32_t v = instrument.voice_begin; v < instrument.voice_end; ++v) {
+		GlitchSynth const &voice = voices[v];
+		int rank = 0;
+		if (!voice.is_on) {
+			rank = 2;
+		} else if (voice.adsr_state == GlitchSynth::ADSR_RELEASE || voice.adsr_state == GlitchSynth::ADSR_END) {
+			rank = 1;
+		}
+		if (rank > best_rank) {
+			best = v;
+			best_rank = rank;
+		} else if (rank == best_rank) {
+			GlitchSynth const &current = voices[best];
+			if (rank == 1 && voice.env_level < current.env_level) best = v;
+			if (rank == 0 && voice.started_at < current.started_at) best = v;
+		}
+		if (best_rank == 2) break;
+	}
 
-	// zero out buffer
-	for (int i = 0; i < MIX_SAMPLES; i++) {
-		mix_buffer[i] = 0;
+	//voice settings always come from the instrument's patch,
+	// but the envelope level and oscillator phase carry over so a stolen voice doesn't click
+	// (and the voice keeps its own noise stream and filter state):
+	GlitchSynth &voice = voices[best];
+	GlitchSynth const old = voice;
+	voice = instrument.patch;
+	voice.env_level = old.env_level;
+	voice.noise_seed = old.noise_seed;
+	if (old.is_on) {
+		voice.phase = old.phase;
+		voice.noise_counter = old.noise_counter;
+		std::copy(old.pink_state, old.pink_state + 3, voice.pink_state);
+		std::copy(old.svf_state, old.svf_state + 2, voice.svf_state);
+	} else {
+		//a finished voice may have run on to the end of whatever run of samples it finished in,
+		// so start it fresh instead (otherwise the output would depend on where callbacks start and end):
+		voice.phase = 0;
+		voice.noise_counter = uint32_t(now);
+	}
+	voice.note = note;
+	voice.started_at = note_counter++;
+	voice.is_on = true;
+	voice.play(frequency);
+	instrument.is_on = true;
+}
+
+//release every voice of an instrument that is holding 'note':
+void release_note(Sound::Instrument &instrument, int note) {
+	for (uint32_t v = instrument.voice_begin; v < instrument.voice_end; ++v) {
+		Sound::GlitchSynth &voice = voices[v];
+		if (voice.is_on && voice.note == note && voice.adsr_state != Sound::GlitchSynth::ADSR_RELEASE) {
+			voice.do_release = true;
+		}
+	}
+}
+
+Sound::Instrument *get_instrument(int index) {
+	if (index < 0 || uint32_t(index) >= instrument_count.load(std::memory_order_acquire)) return nullptr;
+	return &instruments[index];
+}
+
+//sample time of a sequencer step (computed from scratch every time, so rounding never accumulates):
+uint64_t step_time(SequencePlayer const &player, uint64_t step) {
+	double t = double(step) * player.samples_per_step;
+	if (step % 2 == 1) t += player.swing * player.samples_per_step;
+	return player.start_time + uint64_t(t + 0.5);
+}
+
+//release whatever the sequences are holding:
+void release_sequences(SequencePlayer &player) {
+	for (auto &sequence : player.sequences) {
+		Sound::Instrument *instrument = get_instrument(sequence.instrument);
+		if (instrument && sequence.playing_note != 0) release_note(*instrument, sequence.playing_note);
+		sequence.playing_note = 0;
+	}
+}
+
+//play the sequencer's next step (at sample time 'now'):
+void step_sequences(SequencePlayer &player, uint64_t now) {
+	for (uint32_t i = 0; i < player.sequences.size(); ++i) {
+		Sound::Sequence &sequence = player.sequences[i];
+		if (sequence.steps.empty()) continue;
+		Sound::Sequence::Step const &step = sequence.steps[sequence.current_idx];
+		sequence.current_idx = (sequence.current_idx + 1) % uint32_t(sequence.steps.size());
+
+		Sound::Instrument *instrument = get_instrument(sequence.instrument);
+		if (!instrument || step.note == 0) continue;
+		if (step.note > 0) {
+			start_note(*instrument, step.note, step.frequency, now);
+			sequence.playing_note = step.note;
+			if (sequence.report_notes) {
+				Sound::SequenceEvent event;
+				event.sequence = i;
+				event.note = step.note;
+				event.time = now;
+				sequence_events.push(event); //(if the game isn't polling, events just get dropped)
+			}
+		} else {
+			release_note(*instrument, sequence.playing_note);
+		}
+	}
+	player.step += 1;
+	player.next_time = step_time(player, player.step);
+}
+
+void apply_command(Command const &command, uint64_t now) {
+	if (command.type == Command::PLAY_SAMPLE) {
+		//(there are only MAX_PLAYING_SAMPLES slots, so this always fits)
+		assert(active_sample_count < MAX_PLAYING_SAMPLES);
+		active_samples[active_sample_count++] = command.slot;
+		return;
+	} else if (command.type == Command::PLAY_SEQUENCES) {
+		if (sequence_player) {
+			release_sequences(*sequence_player);
+			done_sequence_players.push(sequence_player); //(game thread frees it)
+		}
+		sequence_player = command.player;
+		sequence_player->start_time = now;
+		sequence_player->step = 0;
+		sequence_player->next_time = now;
+		return;
+	} else if (command.type == Command::STOP_SEQUENCES) {
+		if (sequence_player) {
+			release_sequences(*sequence_player);
+			done_sequence_players.push(sequence_player); //(game thread frees it)
+		}
+		sequence_player = nullptr;
+		return;
+	} else if (command.type == Command::CLEAR_INSTRUMENTS) {
+		sequence_player = nullptr;
+		for (auto &voice : voices) {
+			voice.is_on = false;
+		}
+		for (auto &instrument : instruments) {
+			instrument.is_on = false;
+		}
+		pending_count = 0;
+		//(the game thread is waiting on clears_done, so it isn't touching instrument_count)
+		instrument_count.store(0, std::memory_order_relaxed);
+		clears_applied += 1;
+		return;
+	}
+
+	Sound::Instrument *instrument_ = get_instrument(command.instrument);
+	if (!instrument_) return;
+	Sound::Instrument &instrument = *instrument_;
+
+	if (command.type == Command::NOTE_ON) {
+		start_note(instrument, command.note, command.value, now);
+	} else if (command.type == Command::NOTE_OFF) {
+		release_note(instrument, command.note);
+	} else if (command.type == Command::SET_PARAM) {
+		//change the patch (for future notes) and every voice (for current notes):
+		auto set = [&command](Sound::GlitchSynth &synth) {
+			if (command.param == Sound::PARAM_VOLUME) {
+				synth.volume = command.value;
+			} else if (command.param == Sound::PARAM_FILTER_CUTOFF) {
+				synth.filter_cutoff = command.value;
+				synth.update_filter();
+			} else if (command.param == Sound::PARAM_FILTER_RESONANCE) {
+				synth.filter_resonance = command.value;
+				synth.update_filter();
+			}
+		};
+		set(instrument.patch);
+		for (uint32_t v = instrument.voice_begin; v < instrument.voice_end; ++v) {
+			set(voices[v]);
+		}
+	}
+}
+
+//move everything from the command queue to the pending list (in time order):
+void drain_commands(uint64_t now) {
+	Command command;
+	while (commands.pop(&command)) {
+		//samples start with the next chunk (and shouldn't be dropped by CLEAR_INSTRUMENTS), so they skip the pending list:
+		if (command.type == Command::PLAY_SAMPLE) {
+			apply_command(command, now);
+			continue;
+		}
+		if (pending_count == MAX_PENDING) {
+			//no room to wait; apply it now rather than lose it:
+			apply_command(command, now);
+			continue;
+		}
+		uint32_t i = pending_count;
+		while (i > 0 && pending[i-1].time > command.time) {
+			pending[i] = pending[i-1];
+			i -= 1;
+		}
+		pending[i] = command;
+		pending_count += 1;
 	}
+}
 
-	// only run active synths
-	for (int i = 0; i < Sound::NUM_SYNTHS; i++) {
-		if (synths[i].is_on) {
-			// get the ith synth to add its samples to mix_buffer
-			synths[i].generate_samples(MIX_SAMPLES, mix_buffer);
-			on_counter++;
+//mix 'count' samples of every playing instrument into mix_buffer, starting at 'offset':
+void render_instruments(uint32_t offset, uint32_t count) {
+	uint32_t instrument_total = instrument_count.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < instrument_total; i++) {
+		Sound::Instrument const &instrument = instruments[i];
+		if (!instrument.is_on) continue;
+		// get the active voices to add their samples to mix_buffer, in groups that share filter lanes:
+		Sound::GlitchSynth *group[SVF_LANES];
+		uint32_t group_size = 0;
+		for (uint32_t v = instrument.voice_begin; v < instrument.voice_end; ++v) {
+			if (!voices[v].is_on) continue;
+			group[group_size++] = &voices[v];
+			if (group_size == SVF_LANES) {
+				Sound::GlitchSynth::render_group(group, group_size, count, mix_buffer.data() + offset);
+				group_size = 0;
+			}
+		}
+		if (group_size > 0) {
+			Sound::GlitchSynth::render_group(group, group_size, count, mix_buffer.data() + offset);
 		}
 	}
+}
+
+//output samples are interleaved stereo:
+struct LR {
+	float l;
+	float r;
+};
+static_assert(sizeof(LR) == 8, "Sample is packed");
+
+//crackle and normalize 'count' samples of mix_buffer (starting at 'offset') into 'out':
+// (done one render run at a time, so the result doesn't depend on where callbacks start and end)
+void finish_run(uint32_t offset, uint32_t count, LR *out) {
+	// the mix is normalized by the number of instruments in use
+	int on_counter = 0;
+	uint32_t instrument_total = instrument_count.load(std::memory_order_acquire);
+	for (uint32_t i = 0; i < instrument_total; i++) {
+		if (instruments[i].is_on) on_counter++;
+	}
 
-	// don't waste time running LPF and crackle for empty samples
+	// don't waste time running crackle for empty samples
 	if (on_counter == 0) {
-		for (auto s = 0; s < MIX_SAMPLES; s++) {
-			buffer[s].l = 0;
-			buffer[s].r = 0;
-		}
-	}
-	else {
-		
-		// budget low pass filter (ye olde average) to make the synth sound bearable
-		// output[i] = avg(sample[i-2], sample[i-1], sample[i], sample[i+1], sample[i+2])
-		// an actually competent implementation would use a FFT and a gaussian filter shape or something
-
-		// first, deal with edge cases
-		buffer[0].l = mix_buffer[0] / on_counter;
-		buffer[1].l = mix_buffer[1] / on_counter;
-		buffer[MIX_SAMPLES-1].l = mix_buffer[MIX_SAMPLES-1] / on_counter;
-		buffer[MIX_SAMPLES-2].l = mix_buffer[MIX_SAMPLES-2] / on_counter;
-		buffer[MIX_SAMPLES-3].l = mix_buffer[MIX_SAMPLES-3] / on_counter;
-		buffer[0].r = mix_buffer[0] / on_counter;
-		buffer[1].r = mix_buffer[1] / on_counter;
-		buffer[MIX_SAMPLES-1].r = mix_buffer[MIX_SAMPLES-1] / on_counter;
-		buffer[MIX_SAMPLES-2].r = mix_buffer[MIX_SAMPLES-2] / on_counter;
-		buffer[MIX_SAMPLES-3].r = mix_buffer[MIX_SAMPLES-3] / on_counter;
-
-		float running_buffer = 0.0f;
-		
-		float crackle_factor = 1.0f;
-
-		// initialize running sum
-		for (int i = 0; i < 5; i++) {
-			running_buffer += mix_buffer[i] / on_counter;
-		}
-
-		// do LPF and crackle
-		for (uint32_t s = 2; s < MIX_SAMPLES-3; ++s) {
-			global_sample++;
-
-			// create crackling "sparks" in the output sound, as if our player character is malfunctioning
-			// this relieves some of the suffocation of the monotonous bassline and drums
-			// TODO: use rain sounds etc. to do this instead
-			if (global_sample >= next_crackle) {
-				crackle_duration = 2000 + uint64_t((mt()/float(mt.max())) * 2000);
-				next_crackle = global_sample + 5000 + uint64_t((mt()/float(mt.max())) * 50000);
-				crackle_amount = 0.8f + 0.2f * mt()/float(mt.max());
+		for (uint32_t s = 0; s < count; s++) {
+			out[s].l = 0;
+			out[s].r = 0;
+		}
+		return;
+	}
+
+	// (the oscillators are band-limited, so the mix no longer needs the old 5-tap averaging "LPF")
+	float crackle_factor = 1.0f;
+
+	// one run of noise for the crackle, remapped to [0,1):
+	kernel_noise_uniform(crackle_seed, crackle_counter, count, crackle_noise.data());
+	crackle_counter += count;
+	auto crackle_random = [](uint32_t which) {
+		return 0.5f * float(int32_t(noise_hash(crackle_seed ^ which, uint32_t(global_sample))) >> 8) * (1.0f / float(1 << 23)) + 0.5f;
+	};
+
+	// do crackle
+	float const *mix_run = mix_buffer.data() + offset;
+	for (uint32_t s = 0; s < count; ++s) {
+		global_sample++;
+
+		// create crackling "sparks" in the output sound, as if our player character is malfunctioning
+		// this relieves some of the suffocation of the monotonous bassline and drums
+		// TODO: use rain sounds etc. to do this instead
+		if (global_sample >= next_crackle) {
+			crackle_duration = 2000 + uint64_t(crackle_random(1) * 2000);
+			next_crackle = global_sample + 5000 + uint64_t(crackle_random(2) * 50000);
+			crackle_amount = 0.8f + 0.2f * crackle_random(3);
+		}
+		if (crackle_duration == 0) {
+			crackle_factor = 1.0f;
+		}
+		else {
+			crackle_duration--;
+			crackle_factor = (1.0f - crackle_amount) * (0.5f * crackle_noise[s] + 0.5f) + crackle_amount;
+		}
+		float mix = crackle_factor * mix_run[s] / on_counter;
+		out[s].l = mix;
+		out[s].r = mix;
+	}
+}
+
+//left and right gains of a playing sample (including the global volume), given the listener's position:
+void sample_gains(SampleSlot const &sample_slot, glm::vec3 const &listener_position, glm::vec3 const &listener_right, float global_volume, float *left, float *right) {
+	if (sample_slot.pan.value == sample_slot.pan.value) {
+		compute_pan_weights(sample_slot.pan.value, left, right);
+	} else {
+		compute_pan_from_listener_and_position(listener_position, listener_right, sample_slot.position.value, sample_slot.half_volume_radius.value, left, right);
+	}
+	float volume = global_volume * sample_slot.volume.value;
+	*left *= volume;
+	*right *= volume;
+}
+
+//add 'count' samples of every active sample slot to 'out':
+// gains are worked out from the ramps at both ends of the chunk and interpolated per sample (so ramps don't step);
+// finished slots go back to the game thread through free_sample_slots.
+void mix_samples(uint32_t count, LR *out) {
+	float const step = float(count) / float(AUDIO_RATE);
+
+	//the listener and global volume ramp over the chunk too:
+	glm::vec3 const listener_position = Sound::listener.position.value;
+	glm::vec3 const listener_right = Sound::listener.right.value;
+	float const global_volume = Sound::volume.value;
+	step_position_ramp(Sound::listener.position, step);
+	step_direction_ramp(Sound::listener.right, step);
+	step_value_ramp(Sound::volume, step);
+
+	for (uint32_t a = 0; a < active_sample_count; /* later */) {
+		uint32_t slot = active_samples[a];
+		SampleSlot &sample_slot = sample_slots[slot];
+		//(streams wait until their first few hundred ms are decoded)
+		if (sample_slot.stream && !sample_slot.stream->ready()) {
+			a += 1;
+			continue;
+		}
+		bool finished = (!sample_slot.stream && sample_slot.size == 0);
+
+		if (!finished) {
+			float left, right;
+			sample_gains(sample_slot, listener_position, listener_right, global_volume, &left, &right);
+
+			step_value_ramp(sample_slot.volume, step);
+			if (sample_slot.pan.value == sample_slot.pan.value) {
+				step_value_ramp(sample_slot.pan, step);
+			} else {
+				step_position_ramp(sample_slot.position, step);
+				step_value_ramp(sample_slot.half_volume_radius, step);
 			}
-			if (crackle_duration == 0) {
-				crackle_factor = 1.0f;
+
+			float end_left, end_right;
+			sample_gains(sample_slot, Sound::listener.position.value, Sound::listener.right.value, Sound::volume.value, &end_left, &end_right);
+			float const left_step = (end_left - left) / float(count);
+			float const right_step = (end_right - right) / float(count);
+
+			if (sample_slot.stream) {
+				//mix whatever the decoder has ready (if it has fallen behind, the rest of the chunk is silent):
+				OpusStream &stream = *sample_slot.stream;
+				uint32_t done = 0;
+				while (done < count) {
+					float const *data;
+					uint32_t piece = std::min(count - done, stream.peek(&data));
+					if (piece == 0) break;
+					kernel_mix_stereo(data, left + left_step * float(done), left_step, right + right_step * float(done), right_step, piece, &out[done].l);
+					stream.consume(piece);
+					done += piece;
+				}
+				if (stream.finished()) finished = true;
+			} else {
+				//mix in contiguous pieces of sample data (looping samples wrap around):
+				uint32_t done = 0;
+				while (done < count) {
+					uint32_t piece = std::min(count - done, sample_slot.size - sample_slot.i);
+					kernel_mix_stereo(sample_slot.data + sample_slot.i, left + left_step * float(done), left_step, right + right_step * float(done), right_step, piece, &out[done].l);
+					done += piece;
+					sample_slot.i += piece;
+					if (sample_slot.i >= sample_slot.size) {
+						if (sample_slot.loop) {
+							sample_slot.i = 0;
+						} else {
+							finished = true;
+							break;
+						}
+					}
+				}
 			}
-			else {
-				crackle_duration--;
-				crackle_factor = (1.0f - crackle_amount) * (mt()/float(mt.max())) + crackle_amount;
+
+			//a stopping sample is done once it has faded out:
+			if (sample_slot.stopping && sample_slot.volume.value == 0.0f) {
+				finished = true;
 			}
-			float mix = crackle_factor * running_buffer / 5.0f;
-			buffer[s].l = mix;
-			buffer[s].r = mix;
+		}
 
-			// update the running sum so we don't recompute ALL of the sums every single time
-			running_buffer = running_buffer - (mix_buffer[s-2]/on_counter) + (mix_buffer[s+3]/on_counter);
+		if (finished) {
+			//stale any handles, then give the slot back:
+			sample_slot.in_use = false;
+			sample_slot.generation.store(sample_slot.generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			bool pushed = free_sample_slots.push(slot);
+			assert(pushed && "free_sample_slots has room for every slot");
+			(void)pushed;
+			active_samples[a] = active_samples[active_sample_count - 1];
+			active_sample_count -= 1;
+		} else {
+			a += 1;
 		}
 	}
 }
 
+//mix 'count' (<= MAX_MIX_SAMPLES) samples into 'out':
+void mix_chunk(uint32_t count, LR *out) {
+	uint64_t block_start = sample_time.load(std::memory_order_relaxed);
+
+	// pick up synth commands from the game thread:
+	drain_commands(block_start);
 
+	// zero out buffer
+	for (uint32_t i = 0; i < count; i++) {
+		mix_buffer[i] = 0;
+	}
+
+	// render in runs between command and sequencer step times, so both land on the exact sample they asked for:
+	uint32_t offset = 0;
+	while (offset < count) {
+		uint64_t now = block_start + offset;
+		uint32_t due = 0;
+		while (due < pending_count && pending[due].time <= now) {
+			apply_command(pending[due], now);
+			due += 1;
+		}
+		if (due > 0 && pending_count > 0) { //(a clear empties the pending list)
+			std::copy(pending + due, pending + pending_count, pending);
+			pending_count -= due;
+		}
+		while (sequence_player && sequence_player->next_time <= now) {
+			step_sequences(*sequence_player, now);
+		}
+
+		uint64_t next = block_start + count;
+		if (pending_count > 0) next = std::min(next, pending[0].time);
+		if (sequence_player) next = std::min(next, sequence_player->next_time);
+		uint32_t end = uint32_t(next - block_start);
+		render_instruments(offset, end - offset);
+		finish_run(offset, end - offset, out + offset);
+		offset = end;
+	}
+
+	// samples go on top of the (finished) synth mix:
+	mix_samples(count, out);
+	sample_time.store(block_start + count, std::memory_order_relaxed);
+}
+
+//The audio callback -- invoked by SDL when it needs more sound to play:
+// (the buffer can be any length; all of the mixer's state carries over between calls)
+void mix_audio(void *, Uint8 *buffer_, int len) {
+	assert(buffer_); //should always have some audio buffer
+
+	in_callback.store(true, std::memory_order_relaxed);
+	auto callback_start = std::chrono::steady_clock::now();
+
+	assert(len % sizeof(LR) == 0); //should always get whole stereo samples
+	LR *buffer = reinterpret_cast< LR * >(buffer_);
+	uint32_t frames = uint32_t(len / sizeof(LR));
+
+	for (uint32_t begin = 0; begin < frames; begin += MAX_MIX_SAMPLES) {
+		mix_chunk(std::min(MAX_MIX_SAMPLES, frames - begin), buffer + begin);
+	}
+
+	// only now (with nothing left reading the old instruments) let clear_instruments() return:
+	clears_done.store(clears_applied, std::memory_order_release);
+
+	// record how much of this buffer's play time the callback used:
+	uint64_t busy = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - callback_start).count());
+	uint64_t period = std::max< uint64_t >(1, uint64_t(frames) * 1000000000ULL / AUDIO_RATE);
+	uint64_t load_ppm = busy * 1000000ULL / period;
+	auto add = [](std::atomic< uint64_t > &counter, uint64_t amount) {
+		//(audio thread is the only writer, so this needn't be an atomic read-modify-write)
+		counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	};
+	add(timing.histogram[std::min< uint64_t >(load_ppm * Sound::CallbackStats::LOAD_BUCKETS / 1000000ULL, Sound::CallbackStats::LOAD_BUCKETS)], 1);
+	add(timing.callbacks, 1);
+	add(timing.busy_ns, busy);
+	add(timing.period_ns, period);
+	timing.last_period_ns.store(period, std::memory_order_relaxed);
+	if (busy > timing.peak_ns.load(std::memory_order_relaxed)) timing.peak_ns.store(busy, std::memory_order_relaxed);
+	if (load_ppm > timing.peak_load_ppm.load(std::memory_order_relaxed)) timing.peak_load_ppm.store(uint32_t(std::min< uint64_t >(load_ppm, 0xffffffffULL)), std::memory_order_relaxed);
+	in_callback.store(false, std::memory_order_relaxed);
+}
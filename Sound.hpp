@@ -1,5 +1,8 @@
 #pragma once
 
+#include "synth_kernels.hpp"
+#include "MappedFile.hpp"
+
 #include <glm/glm.hpp>
 
 #include <memory>
@@ -12,21 +15,25 @@
 
 namespace Sound {
 
-constexpr int NUM_SYNTHS = 6;
+//GlitchSynth voices are preallocated; instruments reserve blocks of them:
+constexpr uint32_t MAX_VOICES = 64;
+constexpr uint32_t MAX_INSTRUMENTS = 16;
 
 /**
  * GlitchSynth - garbage software synth
- * Synth Pipeline: Oscillator -> ADSR Envelope Generator -> (in mix_audio()) Budget LPF -> (in mix_audio()) crackle effect
+ * Synth Pipeline: Oscillator -> Filter -> ADSR Envelope Generator -> (in mix_audio()) crackle effect
  * Oscillators: square, saw, sine, noise
+ * Square, saw, and sine read band-limited, mip-mapped wavetables (built in Sound::init()) with a fixed-point phase accumulator.
  * Most of the "expressiveness" (such as it is) will have to come from the ADSR generator
- * Although the ADSR generator uses linear curves, so doesn't sound too snappy either.
+ * Each envelope segment is a linear or exponential ramp from the *current* level, so retriggers and early releases don't click.
  **/
 struct GlitchSynth {
-	// sample number in the current note
-	uint64_t current_sample_number;
+	// oscillator phase as a 0.32 fixed-point fraction of a cycle (wraps for free)
+	uint32_t phase = 0;
+	uint32_t phase_step = 0;
 
-	// how many samples till the cycle flips
-	uint64_t cycle_length;
+	// which wavetable mip level to read; chosen by play() to keep harmonics under Nyquist
+	uint32_t wavetable_level = 0;
 
 	// ADSR target amplitude
 	float attack_amplitude = 0.0f;
@@ -39,7 +46,15 @@ struct GlitchSynth {
 	uint64_t attack_threshold = 0;
 	uint64_t decay_threshold = 0;
 	uint64_t release_threshold = 0;
-	uint64_t release_start = 0;
+
+	// ADSR segment shapes
+	enum Curve {
+		CURVE_LINEAR,
+		CURVE_EXPONENTIAL
+	};
+	Curve attack_curve = CURVE_LINEAR;
+	Curve decay_curve = CURVE_LINEAR;
+	Curve release_curve = CURVE_LINEAR;
 
 	enum {
 		ADSR_ATTACK,
@@ -47,7 +62,18 @@ struct GlitchSynth {
 		ADSR_SUSTAIN,
 		ADSR_RELEASE,
 		ADSR_END
-	} adsr_state = ADSR_ATTACK;
+	} adsr_state = ADSR_END;
+
+	// envelope state: the current segment moves env_level to env_target over env_left samples
+	//  linear segments add env_step every sample;
+	//  exponential segments head for env_goal (just past env_target) via level = goal + (level - goal) * env_mul
+	float env_level = 0.0f;
+	float env_target = 0.0f;
+	float env_step = 0.0f;
+	float env_goal = 0.0f;
+	float env_mul = 1.0f;
+	Curve env_curve = CURVE_LINEAR;
+	uint64_t env_left = 0;
 
 	enum {
 		OSC_SQUARE,
@@ -56,33 +82,103 @@ struct GlitchSynth {
 		OSC_NOISE
 	} osc = OSC_SINE;
 
+	// OSC_NOISE settings/state: each voice has its own counter-based noise stream (see synth_kernels.hpp)
+	enum NoiseShape {
+		NOISE_UNIFORM,
+		NOISE_TRIANGULAR, // peaked at zero; a bit less harsh than uniform
+		NOISE_PINK
+	} noise_shape = NOISE_UNIFORM;
+	uint32_t noise_seed = 0;
+	uint32_t noise_counter = 0;
+	float pink_state[3] = {0.0f, 0.0f, 0.0f};
+
+	// per-voice state-variable filter; cutoff in Hz, resonance as Q (0.707 == no peak)
+	enum {
+		FILTER_OFF,
+		FILTER_LOWPASS,
+		FILTER_BANDPASS,
+		FILTER_HIGHPASS
+	} filter = FILTER_OFF;
+	float filter_cutoff = 1000.0f;
+	float filter_resonance = 0.707f;
+	SvfCoefficients svf; // computed from the settings above by play() / update_filter()
+	float svf_state[2] = {0.0f, 0.0f}; // carried across callbacks (and notes)
+
 	bool do_release = false;
 	bool is_on = false;
 
-	// start playing a new note
+	// voice bookkeeping (used by the voice allocator for stealing):
+	int note = -1; // caller-supplied id of the note being played
+	uint64_t started_at = 0; // note_on() counter value when this voice was (re)started
+
+	// start playing a new note (the attack starts from the current envelope level)
 	void play(float frequency);
 
-	void set_attack(float amp, uint64_t at);
-	void set_decay(float amp, uint64_t dt);
+	// recompute 'svf' after changing the filter settings:
+	void update_filter();
+
+	void set_attack(float amp, uint64_t at, Curve curve = CURVE_LINEAR);
+	void set_decay(float amp, uint64_t dt, Curve curve = CURVE_LINEAR);
 	void set_sustain(float amp);
-	void set_release(float amp, uint64_t rt);
+	void set_release(float amp, uint64_t rt, Curve curve = CURVE_LINEAR);
+
+	// set up the envelope to move from env_level to 'target' over 'length' samples:
+	void begin_segment(float target, uint64_t length, Curve curve);
+	// called when env_left reaches zero:
+	void end_segment();
 
 	// generate n new samples into given vector
 	// we assume here that the vector can actually hold n samples
+	// (per-sample reference implementation; mix_audio() uses render(), which is checked against this)
 	void generate_samples(int n, std::vector<float>& buffer);
+
+	// block renderer: add n samples of this voice to out
+	// the oscillator type and envelope segment are decided once per run of samples, not per sample,
+	// and the per-sample work is done by the SIMD kernels in synth_kernels.hpp
+	static constexpr uint32_t BLOCK_SIZE = 256;
+	void render(uint32_t n, float *out);
+	// render up to SVF_LANES voices together, so that their filters can share SIMD lanes:
+	static void render_group(GlitchSynth *const *group, uint32_t count, uint32_t n, float *out);
+
+	// the stages of render(); each writes (rather than adds) n <= BLOCK_SIZE samples:
+	void render_oscillator(uint32_t n, float *out);
+	void render_envelope(uint32_t n, float *out);
+	// (OSC_NOISE part of render_oscillator(); generate_samples() uses it one sample at a time)
+	void render_noise(uint32_t n, float *out);
+};
+
+// Instrument - a patch plus a fixed block of voices from the voice pool
+// note_on() copies the patch settings into a free (or stolen) voice, so notes
+// of the same instrument can overlap instead of cutting each other off.
+struct Instrument {
+	GlitchSynth patch;
+	uint32_t voice_begin = 0;
+	uint32_t voice_end = 0;
+	// latched on the first note; used to normalize the mix
+	bool is_on = false;
 };
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
 	//Load from a '.wav' or '.opus' file.
-	//  will warn and convert if sound is not already 48kHz mono:
+	//  will warn and convert if sound is not already 48kHz mono.
+	//  the decoded audio is cached on disk (see pcm_cache.hpp), so later runs just memory-map it:
 	Sample(std::string const &filename);
 	
 	//Directly supply an audio buffer:
 	Sample(std::vector< float > const &data);
 
+	//(data may point into the sample itself, so samples can't be copied)
+	Sample(Sample const &) = delete;
+	Sample &operator=(Sample const &) = delete;
+
 	//sample data is stored as 48kHz, mono, floating-point:
-	std::vector< float > data;
+	float const *data = nullptr;
+	size_t size = 0;
+
+	//internals -- where 'data' points (one or the other):
+	std::vector< float > buffer;
+	MappedFile mapped;
 };
 
 
@@ -109,60 +205,62 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' is a handle to a sample that is currently playing (returned by the play and loop functions below):
+// handles are small values, so copy them around freely; once the sample finishes (or is stopped and fades out)
+// the handle goes stale and its functions do nothing.
 struct PlayingSample {
 	//change the panning or volume of a playing sample (and do proper locking);
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
-	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
+	void set_volume(float new_volume, float ramp = 1.0f / 60.0f) const;
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
-	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
+	void set_pan(float new_pan, float ramp = 1.0f / 60.0f) const;
 	//set the position of a sample (use only on samples in "3D" mode; no effect on "2D" samples):
-	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
+	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f) const;
 	//set the half-volume radius (use only on "3D" playing sounds):
-	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f) const;
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
-	void stop(float ramp = 1.0f / 60.0f);
+	void stop(float ramp = 1.0f / 60.0f) const;
+
+	//is the sample still playing (or about to start)?
+	bool playing() const;
 
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	// the sample lives in slot 'slot' of a fixed table (in Sound.cpp) for as long as that slot's generation matches 'generation'
+	uint32_t slot = -1U;
+	uint32_t generation = 0;
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions:
+// 'buffer_samples' (128, 256, 512, or 1024) is the callback length to ask the audio device for;
+// smaller buffers mean less latency but less time for each callback to finish.
+// The device may grant a different size; get_buffer_samples() reports what it picked (0 if no device is open).
+void init(uint32_t buffer_samples = 1024);
+uint32_t get_buffer_samples();
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Offline rendering: call Sound::init_offline() instead of Sound::init() to set up the mixer without
+// an audio device, then call Sound::mix() to run the same mixer the audio callback uses:
+void init_offline();
+void mix(float *out, uint32_t frames); //writes 'frames' interleaved stereo frames
+
+//seed the synth's noise streams (per-voice noise and crackle); call before add_instrument() for repeatable output:
+void set_seed(uint32_t seed);
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  (at most 256 samples play at once; past that, the play and loop functions return a stale handle)
+//  'sample' must outlive the playback.
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -171,19 +269,30 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//Call 'Sound::stream' to play a long '.opus' file (e.g., background music) without loading it first:
+//  it is decoded a little ahead of playback on a background thread, so it costs a fixed amount of memory
+//  and starts playing once its first quarter second is decoded. Throws if the file can't be opened.
+//  (returns a handle, like Sound::play)
+PlayingSample stream(
+	std::string const &filename,
+	float volume = 1.0f,
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	bool loop = false
+);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -194,6 +303,68 @@ struct Listener {
 };
 extern struct Listener listener;
 
+//Synth control never locks the audio thread: note and parameter changes are queued
+// (wait-free) and applied by the audio callback at sample time 'when'.
+// 'when' is in samples on the get_sample_time() clock; 0 (or any time already past) means "as soon as possible".
+// All of these functions should be called from the game (main) thread only.
+
+//Instruments reserve 'voices' voices from the preallocated pool:
+// returns the instrument index, or -1 if the instrument or voice pool is exhausted.
+int add_instrument(GlitchSynth const &patch, uint32_t voices);
+
+//release all instruments (and their voices) so the pool can be reused:
+// (waits for the audio callback to finish with them)
+void clear_instruments();
+
+//number of samples the audio callback has mixed so far:
+uint64_t get_sample_time();
+
+//start playing 'note' (any caller-chosen id) on an instrument:
+// uses a free voice if there is one, otherwise steals the quietest releasing voice or, failing that, the oldest voice.
+void note_on(int instrument, int note, float frequency, uint64_t when = 0);
+
+//release every voice of an instrument that is holding 'note':
+void note_off(int instrument, int note, uint64_t when = 0);
+
+//change a setting on an instrument's patch and all of its voices:
+enum Param {
+	PARAM_VOLUME,
+	PARAM_FILTER_CUTOFF, //Hz
+	PARAM_FILTER_RESONANCE //Q
+};
+void set_param(int instrument, Param param, float value, uint64_t when = 0);
+
+//Sequence - a looping pattern of steps for one instrument, played by the audio callback
+// (so timing is sample-accurate and doesn't depend on the frame rate):
+struct Sequence {
+	struct Step {
+		int note = 0; //positive: start playing note id; negative: release the current note; 0: rest
+		float frequency = 0.0f; //(for positive notes)
+	};
+	std::vector< Step > steps;
+	int instrument = -1;
+	bool report_notes = false; //send this sequence's note-ons back to the game (see poll_sequence_event())
+
+	//internals (used by the audio thread):
+	uint32_t current_idx = 0;
+	int playing_note = 0;
+};
+
+//Start looping 'sequences' (replacing any that were playing) as soon as possible:
+// every sequence advances one step per 1/steps_per_beat of a beat;
+// 'swing' delays every other step by that fraction of a step (0 == straight, ~0.33 == triplet feel).
+void play_sequences(std::vector< Sequence > const &sequences, float bpm, float swing = 0.0f, uint32_t steps_per_beat = 4);
+void stop_sequences();
+
+//Note-ons from sequences with report_notes set, in the order they were played:
+struct SequenceEvent {
+	uint32_t sequence = 0; //index into the vector passed to play_sequences()
+	int note = 0;
+	uint64_t time = 0; //sample time of the note-on
+};
+//returns false when there are no more events:
+bool poll_sequence_event(SequenceEvent *event);
+
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
@@ -202,9 +373,33 @@ void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions for samples already use these helpers, so you shouldn't need
+// to call them unless your code is modifying values directly (synth functions use the command queue instead):
 void lock();
 void unlock();
 
+//Audio callback timing, gathered (lock-free) by the callback itself; safe to query from the game thread at any time
+// to see how close the mixer is to missing its deadline:
+struct CallbackStats {
+	//"load" is how long a callback took as a fraction of its period (the time it takes to play the buffer it filled);
+	// the histogram counts callbacks in LOAD_BUCKETS 5%-wide load buckets, plus a last bucket for xruns (load >= 100%):
+	static constexpr uint32_t LOAD_BUCKETS = 20;
+	uint64_t histogram[LOAD_BUCKETS + 1] = {};
+	uint64_t callbacks = 0;
+	uint64_t xruns = 0; //callbacks that missed their deadline (same as the last histogram bucket)
+	float mean_load = 0.0f;
+	float peak_load = 0.0f;
+	float peak_ms = 0.0f; //longest callback
+	float period_ms = 0.0f; //period of the most recent callback
+
+	//Sound::lock() calls, and how many of them had to wait for a running callback (or another lock):
+	uint64_t locks = 0;
+	uint64_t contended_locks = 0;
+	float peak_lock_wait_ms = 0.0f;
+};
+CallbackStats get_callback_stats();
+void reset_callback_stats();
+//print a summary to std::cout (Sound::shutdown() does this too, if the callback ever ran):
+void dump_callback_stats();
+
 } //namespace Sound
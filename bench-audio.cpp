@@ -0,0 +1,196 @@
+//bench-audio: times the synth's DSP stages and prints the results as JSON
+// (so runs from before and after a change to Sound.cpp or synth_kernels.cpp can be diffed).
+//
+// Usage: bench-audio [--quick] > results.json
+
+#include "Sound.hpp"
+#include "synth_kernels.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+//how long to run each case (per repetition), and how many repetitions to take the best of:
+static double min_seconds = 0.05;
+static uint32_t repetitions = 5;
+
+//results are printed as they are measured:
+static bool first_result = true;
+static void report(std::string const &stage, std::string const &variant, uint32_t block_size, uint32_t voices, double ns_per_sample) {
+	if (!first_result) std::cout << ",\n";
+	first_result = false;
+	std::cout << "\t\t{ \"stage\": \"" << stage << "\", \"variant\": \"" << variant << "\""
+		<< ", \"block_size\": " << block_size << ", \"voices\": " << voices
+		<< ", \"ns_per_sample\": " << std::fixed << std::setprecision(3) << ns_per_sample << " }";
+	std::cout.flush();
+}
+
+//run 'fn' (which processes 'samples' samples per call) repeatedly; returns the best ns/sample over a few repetitions:
+static double time_per_sample(uint64_t samples, std::function< void() > const &fn) {
+	double best = std::numeric_limits< double >::infinity();
+	for (uint32_t rep = 0; rep < repetitions; ++rep) {
+		uint64_t calls = 0;
+		auto before = std::chrono::steady_clock::now();
+		double elapsed = 0.0;
+		do {
+			for (uint32_t i = 0; i < 16; ++i) fn();
+			calls += 16;
+			elapsed = std::chrono::duration< double >(std::chrono::steady_clock::now() - before).count();
+		} while (elapsed < min_seconds);
+		best = std::min(best, elapsed * 1e9 / double(calls * samples));
+	}
+	return best;
+}
+
+//every benchmark folds its output in here, so the compiler can't skip the work:
+static float sink = 0.0f;
+
+//a sustained note with a filter, for stages that need a playing voice:
+static Sound::GlitchSynth make_voice(int osc, float frequency) {
+	Sound::GlitchSynth voice;
+	voice.set_attack(1.0f, 100);
+	voice.set_decay(0.7f, 500);
+	voice.set_sustain(0.7f);
+	voice.set_release(0.0f, 3000);
+	voice.osc = decltype(voice.osc)(osc);
+	voice.filter = Sound::GlitchSynth::FILTER_LOWPASS;
+	voice.filter_cutoff = 2000.0f;
+	voice.filter_resonance = 1.2f;
+	voice.volume = 0.5f;
+	voice.is_on = true;
+	voice.play(frequency);
+	return voice;
+}
+
+int main(int argc, char **argv) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--quick") {
+			min_seconds = 0.005;
+			repetitions = 2;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--quick] > results.json" << std::endl;
+			return 1;
+		}
+	}
+
+	//sets up wavetables etc. without opening an audio device:
+	Sound::init_offline();
+
+	std::cout << "{\n\t\"benchmarks\": [\n";
+
+	std::vector< uint32_t > const block_sizes = {32, 64, 128, Sound::GlitchSynth::BLOCK_SIZE};
+	std::vector< float > out(Sound::GlitchSynth::BLOCK_SIZE * SVF_LANES);
+
+	{ //oscillators:
+		struct {
+			char const *name;
+			int osc;
+			Sound::GlitchSynth::NoiseShape shape;
+		} const oscillators[] = {
+			{"square", Sound::GlitchSynth::OSC_SQUARE, Sound::GlitchSynth::NOISE_UNIFORM},
+			{"saw", Sound::GlitchSynth::OSC_SAW, Sound::GlitchSynth::NOISE_UNIFORM},
+			{"sine", Sound::GlitchSynth::OSC_SINE, Sound::GlitchSynth::NOISE_UNIFORM},
+			{"noise_uniform", Sound::GlitchSynth::OSC_NOISE, Sound::GlitchSynth::NOISE_UNIFORM},
+			{"noise_triangular", Sound::GlitchSynth::OSC_NOISE, Sound::GlitchSynth::NOISE_TRIANGULAR},
+			{"noise_pink", Sound::GlitchSynth::OSC_NOISE, Sound::GlitchSynth::NOISE_PINK},
+		};
+		for (auto const &o : oscillators) {
+			for (uint32_t block_size : block_sizes) {
+				Sound::GlitchSynth voice = make_voice(o.osc, 261.0f);
+				voice.noise_shape = o.shape;
+				double ns = time_per_sample(block_size, [&]() {
+					voice.render_oscillator(block_size, out.data());
+					sink += out[0];
+				});
+				report("oscillator", o.name, block_size, 1, ns);
+			}
+		}
+	}
+
+	{ //envelope (long segments, so this measures the ramps rather than the segment changes):
+		for (auto curve : {Sound::GlitchSynth::CURVE_LINEAR, Sound::GlitchSynth::CURVE_EXPONENTIAL}) {
+			for (uint32_t block_size : block_sizes) {
+				Sound::GlitchSynth voice = make_voice(Sound::GlitchSynth::OSC_SINE, 261.0f);
+				double ns = time_per_sample(block_size, [&]() {
+					voice.begin_segment(0.5f, 1 << 20, curve);
+					voice.render_envelope(block_size, out.data());
+					sink += out[0];
+				});
+				report("envelope", (curve == Sound::GlitchSynth::CURVE_LINEAR ? "linear" : "exponential"), block_size, 1, ns);
+			}
+		}
+	}
+
+	{ //filter (ns per sample per voice):
+		// (the same buffer gets filtered over and over, so this uses a filter with no resonant peak to keep it from blowing up)
+		for (uint32_t lanes = 1; lanes <= SVF_LANES; ++lanes) {
+			for (uint32_t block_size : block_sizes) {
+				SvfCoefficients coefficients = svf_coefficients(SVF_LOWPASS, 2000.0f / 48000.0f, 0.707f);
+				float state[SVF_LANES][2] = {};
+				SvfCoefficients const *c[SVF_LANES];
+				float *s[SVF_LANES];
+				float *io[SVF_LANES];
+				for (uint32_t l = 0; l < SVF_LANES; ++l) {
+					c[l] = &coefficients;
+					s[l] = state[l];
+					io[l] = out.data() + l * Sound::GlitchSynth::BLOCK_SIZE;
+				}
+				kernel_noise_uniform(1, 0, uint32_t(out.size()), out.data());
+				double ns = time_per_sample(uint64_t(block_size) * lanes, [&]() {
+					kernel_svf(lanes, c, s, io, block_size);
+					sink += out[0];
+				});
+				report("filter", "svf_lowpass", block_size, lanes, ns);
+			}
+		}
+	}
+
+	{ //whole voices (oscillator + filter + envelope + mix), as mix_audio() groups them; ns per output sample:
+		for (uint32_t voices : {1U, 4U, 16U, 64U}) {
+			for (uint32_t block_size : {64U, 256U, 1024U}) {
+				std::vector< Sound::GlitchSynth > synths;
+				for (uint32_t v = 0; v < voices; ++v) {
+					synths.emplace_back(make_voice(int(v % 3), 100.0f + 37.0f * v));
+				}
+				std::vector< float > mix(block_size);
+				double ns = time_per_sample(block_size, [&]() {
+					std::fill(mix.begin(), mix.end(), 0.0f);
+					for (uint32_t begin = 0; begin < voices; begin += SVF_LANES) {
+						Sound::GlitchSynth *group[SVF_LANES];
+						uint32_t count = std::min(SVF_LANES, voices - begin);
+						for (uint32_t l = 0; l < count; ++l) group[l] = &synths[begin + l];
+						Sound::GlitchSynth::render_group(group, count, block_size, mix.data());
+					}
+					sink += mix[0];
+				});
+				report("voices", "sine_saw_square_lowpass", block_size, voices, ns);
+			}
+		}
+	}
+
+	{ //mixer + crackle stage (one silent voice keeps the crackle running); times one 1024-sample Sound::mix() call:
+		Sound::GlitchSynth patch = make_voice(Sound::GlitchSynth::OSC_SINE, 261.0f);
+		patch.volume = 0.0f;
+		int instrument = Sound::add_instrument(patch, 1);
+		Sound::note_on(instrument, 1, 261.0f);
+		std::vector< float > stereo(2 * 1024);
+		double ns = time_per_sample(1024, [&]() {
+			Sound::mix(stereo.data(), 1024);
+			sink += stereo[0];
+		});
+		report("mixer", "crackle_one_silent_voice", 1024, 1, ns);
+		Sound::clear_instruments();
+	}
+
+	std::cout << "\n\t]\n}" << std::endl;
+
+	//(printed so the work can't be optimized away)
+	std::cerr << "checksum: " << sink << std::endl;
+	return 0;
+}
@@ -0,0 +1,50 @@
+//check-load: checks that Load<> dependency cycles make call_load_functions() throw (rather than wait forever).
+// Exits non-zero on failure.
+//
+// Usage: check-load
+
+#include "Load.hpp"
+
+#include <iostream>
+#include <string>
+
+//an explicit-dependency Load with an early tag that lists a tag-ordered Load
+// (which, in turn, waits on every earlier-tagged Load):
+extern Load< void > tag_ordered;
+Load< void > early(LoadTagEarly, LoadOnWorkerThread, {tag_ordered}, [](){ });
+Load< void > tag_ordered(LoadTagDefault, [](){ });
+
+//two explicit-dependency Loads that list each other:
+extern Load< void > second;
+Load< void > first(LoadTagDefault, LoadOnMainThread, {second}, [](){ });
+Load< void > second(LoadTagDefault, LoadOnWorkerThread, {first}, [](){ });
+
+//a Load outside the cycles, which should still run:
+static bool ran = false;
+Load< void > independent(LoadTagDefault, LoadOnWorkerThread, {}, [](){ ran = true; });
+
+int main(int argc, char **argv) {
+	if (argc != 1) {
+		std::cerr << "Usage:\n\t" << argv[0] << std::endl;
+		return 1;
+	}
+
+	bool ok = true;
+	try {
+		call_load_functions();
+		std::cerr << "FAILED: call_load_functions() didn't throw for cyclic dependencies." << std::endl;
+		ok = false;
+	} catch (std::exception &e) {
+		if (std::string(e.what()).find("cycle") == std::string::npos) {
+			std::cerr << "FAILED: call_load_functions() threw something other than a cycle error: " << e.what() << std::endl;
+			ok = false;
+		}
+	}
+	if (!ran) {
+		std::cerr << "FAILED: a Load outside the cycles didn't run." << std::endl;
+		ok = false;
+	}
+
+	if (ok) std::cout << "check-load: ok" << std::endl;
+	return ok ? 0 : 1;
+}
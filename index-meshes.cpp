@@ -0,0 +1,114 @@
+//index-meshes: converts a '.pnct' file (triangle soup) to a '.pnci' file (indexed triangles)
+// by merging identical vertices and reordering each mesh's triangles for the vertex cache.
+//
+// Usage: index-meshes <in.pnct> <out.pnci>
+//
+// '.pnci' files hold the same vertex format, in chunks:
+//   'pnct' -- unique vertices (each mesh's vertices are contiguous)
+//   'ix32' -- uint32_t indices into the whole vertex array (three per triangle)
+//   'str0' -- mesh names
+//   'idx1' -- per mesh: name begin/end, vertex begin/end, and index begin/end
+
+#include "mesh_index.hpp"
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.pnct> <out.pnci>" << std::endl;
+		return 1;
+	}
+	std::string in_file = argv[1];
+	std::string out_file = argv[2];
+
+	//(matches MeshBuffer's vertex format, but only the size matters here)
+	constexpr uint32_t Stride = 3*4+3*4+4*1+2*4;
+	struct Vertex {
+		uint8_t bytes[Stride];
+	};
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	struct IndexedEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t index_begin, index_end;
+	};
+	static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+	std::vector< Vertex > soup;
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	try {
+		std::ifstream file(in_file, std::ios::binary);
+		if (!file) throw std::runtime_error("Failed to open file.");
+		read_chunk(file, "pnct", &soup);
+		read_chunk(file, "str0", &strings);
+		read_chunk(file, "idx0", &index);
+	} catch (std::exception &e) {
+		std::cerr << "ERROR reading '" << in_file << "': " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::vector< Vertex > vertices;
+	std::vector< uint32_t > indices;
+	std::vector< IndexedEntry > indexed;
+	float soup_misses = 0.0f, indexed_misses = 0.0f;
+
+	for (auto const &entry : index) {
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= soup.size() && (entry.vertex_end - entry.vertex_begin) % 3 == 0)) {
+			std::cerr << "ERROR: index entry in '" << in_file << "' has out-of-range (or non-triangle) vertex start/count." << std::endl;
+			return 1;
+		}
+		uint32_t count = entry.vertex_end - entry.vertex_begin;
+
+		std::vector< uint8_t > mesh_vertices;
+		std::vector< uint32_t > mesh_indices;
+		//(not soup[entry.vertex_begin], which is out of range for an empty mesh at the end of the soup)
+		deduplicate_vertices(reinterpret_cast< uint8_t const * >(soup.data()) + size_t(entry.vertex_begin) * Stride, count, Stride, &mesh_vertices, &mesh_indices);
+		optimize_vertex_cache(Stride, &mesh_vertices, &mesh_indices);
+
+		uint32_t mesh_vertex_count = uint32_t(mesh_vertices.size() / Stride);
+		soup_misses += 3.0f * (count / 3);
+		indexed_misses += average_cache_miss_ratio(mesh_indices, mesh_vertex_count) * (count / 3);
+
+		IndexedEntry out;
+		out.name_begin = entry.name_begin;
+		out.name_end = entry.name_end;
+		out.vertex_begin = uint32_t(vertices.size());
+		out.vertex_end = out.vertex_begin + mesh_vertex_count;
+		out.index_begin = uint32_t(indices.size());
+		out.index_end = out.index_begin + uint32_t(mesh_indices.size());
+		indexed.emplace_back(out);
+
+		vertices.resize(out.vertex_end);
+		if (!mesh_vertices.empty()) std::memcpy(reinterpret_cast< uint8_t * >(vertices.data()) + size_t(out.vertex_begin) * Stride, mesh_vertices.data(), mesh_vertices.size());
+		for (uint32_t i : mesh_indices) {
+			indices.emplace_back(out.vertex_begin + i);
+		}
+	}
+
+	std::ofstream out(out_file, std::ios::binary);
+	write_chunk("pnct", vertices, &out);
+	write_chunk("ix32", indices, &out);
+	write_chunk("str0", strings, &out);
+	write_chunk("idx1", indexed, &out);
+	if (!out) {
+		std::cerr << "ERROR writing '" << out_file << "'." << std::endl;
+		return 1;
+	}
+
+	size_t triangles = indices.size() / 3;
+	std::cout << "Wrote " << out.tellp() << " bytes to '" << out_file << "': "
+		<< soup.size() << " vertices merged to " << vertices.size() << ", "
+		<< triangles << " triangles; vertices transformed per triangle (16-entry FIFO) "
+		<< (triangles ? soup_misses / triangles : 0.0f) << " -> " << (triangles ? indexed_misses / triangles : 0.0f) << "." << std::endl;
+
+	return 0;
+}
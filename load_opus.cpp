@@ -1,54 +1,130 @@
 #include "load_opus.hpp"
+#include "synth_kernels.hpp"
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
+#include <exception>
 #include <memory>
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
+#include <thread>
 
-void load_opus(std::string const &filename, std::vector< float > *data_) {
-	assert(data_);
-	auto &data = *data_;
-	data.clear();
+//files shorter than two of these are decoded on the calling thread;
+// longer files are split into (at most one per core) segments no shorter than this:
+static constexpr ogg_int64_t MIN_SEGMENT = 4 * 48000;
 
-	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+typedef std::unique_ptr< OggOpusFile, decltype(&op_free) > OpusFilePtr;
 
+static OpusFilePtr open_opus(std::string const &filename) {
 	//will hold opusfile * int a std::unique_ptr so that it will automatically be deleted:
 	int err = 0;
-	std::unique_ptr< OggOpusFile, decltype(&op_free) > op(
+	OpusFilePtr op(
 		op_open_file(filename.c_str(), &err), //pointer to hold
 		op_free //deletion function
 	);
 	if (err != 0) {
 		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
 	}
+	return op;
+}
+
+//decode (up to) 'count' samples starting at sample 'start' into 'out', downmixing to mono;
+// returns the number of samples decoded (fewer than 'count' only if the file ended first):
+static ogg_int64_t decode_segment(OggOpusFile *op, std::string const &filename, ogg_int64_t start, ogg_int64_t count, float *out) {
+	if (start != 0) {
+		int ret = op_pcm_seek(op, start);
+		if (ret != 0) {
+			throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+		}
+	}
+
+	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
+	ogg_int64_t decoded = 0;
+	while (decoded < count) {
+		//(never ask for more than the segment needs, so segments don't overlap)
+		int want = int(std::min< ogg_int64_t >(pcm.size() / 2, count - decoded));
+		int ret = op_read_float_stereo(op, pcm.data(), 2 * want);
+		if (ret < 0) {
+			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+		}
+		if (ret == 0) break;
+		//positive return values are the number of samples read per channel; downmix into out:
+		kernel_downmix_stereo(pcm.data(), uint32_t(ret), out + decoded);
+		decoded += ret;
+	}
+	return decoded;
+}
+
+void load_opus(std::string const &filename, std::vector< float > *data_) {
+	assert(data_);
+	auto &data = *data_;
+	data.clear();
+
+	std::cout << "loading '" << filename << "'..."; std::cout.flush();
+
+	OpusFilePtr op = open_opus(filename);
 
 	//get length in samples:
 	ogg_int64_t length = op_pcm_total(op.get(), -1);
-	if (length >= 0) {
-		data.reserve(length);
-	} else {
+	if (length < 0) {
+		//can't seek, so decode serially into a growing buffer:
 		std::cerr << "WARNING: cannot estimate length of '" << filename << "', loading may be slow." << std::endl;
-		length = 0;
-		data.reserve(2*48000);
+		data.resize(2*48000);
+		size_t size = 0;
+		for (;;) {
+			if (data.size() - size < 48000) data.resize(data.size() * 2);
+			ogg_int64_t got = decode_segment(op.get(), filename, 0, ogg_int64_t(data.size() - size), data.data() + size);
+			size += size_t(got);
+			if (size < data.size()) break;
+		}
+		data.resize(size);
+		std::cout << " done." << std::endl;
+		return;
 	}
 
-	std::vector< float > pcm(2*48000*2, 0.0f); //seems like reads are generally 960 samples so this is definitely overkill
-	for (;;) {
-		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
-		if (ret >= 0) {
-			//positive return values are the number of samples read per channel; copy into data:
-			data.reserve(data.size() + ret);
-			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
-				data.emplace_back((pcm[2*i] + pcm[2*i+1]) * 0.5f); //downmix to mono by averaging
-			}
-			if (ret == 0) break;
-		} else {
-			throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	data.resize(size_t(length));
+
+	//split into segments, each decoded by its own thread from its own OggOpusFile:
+	uint32_t segments = uint32_t(std::max< ogg_int64_t >(1, std::min< ogg_int64_t >(std::thread::hardware_concurrency(), length / MIN_SEGMENT)));
+	auto segment_begin = [&](uint32_t s) {
+		return length * s / segments;
+	};
+
+	std::vector< ogg_int64_t > decoded(segments, 0);
+	std::vector< std::exception_ptr > errors(segments, nullptr);
+	auto decode = [&](uint32_t s) {
+		try {
+			OpusFilePtr segment_op = (s == 0 ? std::move(op) : open_opus(filename));
+			ogg_int64_t begin = segment_begin(s);
+			decoded[s] = decode_segment(segment_op.get(), filename, begin, segment_begin(s + 1) - begin, data.data() + begin);
+		} catch (...) {
+			errors[s] = std::current_exception();
+		}
+	};
+
+	std::vector< std::thread > threads;
+	threads.reserve(segments - 1);
+	for (uint32_t s = 1; s < segments; ++s) {
+		threads.emplace_back(decode, s);
+	}
+	decode(0);
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	for (auto const &error : errors) {
+		if (error) std::rethrow_exception(error);
+	}
+	//(only the last segment may come up short)
+	for (uint32_t s = 0; s + 1 < segments; ++s) {
+		if (decoded[s] != segment_begin(s + 1) - segment_begin(s)) {
+			throw std::runtime_error("opusfile ran out of samples before the reported length of \"" + filename + "\".");
 		}
 	}
+	data.resize(size_t(segment_begin(segments - 1) + decoded.back()));
 
 	std::cout << " done." << std::endl;
 }
@@ -10,6 +10,10 @@
 //For sound init:
 #include "Sound.hpp"
 
+//For offline rendering:
+#include "GlitchSong.hpp"
+#include "save_wav.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -25,6 +29,34 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
+#include <vector>
+
+//Render the game's song to a WAV file as fast as the mixer can go (no window or audio device):
+static int render_song(std::string const &filename, float seconds, uint32_t seed) {
+	constexpr uint32_t RENDER_RATE = 48000; //(Sound always mixes at 48kHz)
+	uint32_t frames = uint32_t(seconds * RENDER_RATE);
+	std::vector< float > data(2 * size_t(frames), 0.0f);
+
+	Sound::init_offline();
+	Sound::set_seed(seed);
+
+	auto before = std::chrono::high_resolution_clock::now();
+	{
+		GlitchSong song(seed);
+		Sound::mix(data.data(), frames);
+	}
+	auto after = std::chrono::high_resolution_clock::now();
+	float elapsed = std::chrono::duration< float >(after - before).count();
+
+	std::cout << "Rendered " << seconds << "s of audio in " << elapsed << "s";
+	if (elapsed > 0.0f) std::cout << " (" << seconds / elapsed << "x realtime)";
+	std::cout << "." << std::endl;
+
+	save_wav(filename, data, 2, RENDER_RATE);
+	std::cout << "Wrote '" << filename << "'." << std::endl;
+	return 0;
+}
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -45,6 +77,37 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  offline rendering ------------
+	// glitch --render out.wav [--seconds N] [--seed S]
+	if (argc >= 2 && std::string(argv[1]) == "--render") {
+		std::string filename;
+		float seconds = 60.0f;
+		uint32_t seed = GlitchSong::DEFAULT_SEED;
+		try {
+			for (int i = 2; i < argc; ++i) {
+				std::string arg = argv[i];
+				if (arg == "--seconds" && i + 1 < argc) {
+					seconds = std::stof(argv[++i]);
+				} else if (arg == "--seed" && i + 1 < argc) {
+					seed = uint32_t(std::stoul(argv[++i]));
+				} else if (filename.empty() && arg.substr(0, 2) != "--") {
+					filename = arg;
+				} else {
+					filename.clear();
+					break;
+				}
+			}
+		} catch (std::logic_error &) {
+			//(std::invalid_argument or std::out_of_range from a bad --seconds / --seed value; print usage below)
+			filename.clear();
+		}
+		if (filename.empty() || !(seconds > 0.0f)) {
+			std::cerr << "Usage:\n\t" << argv[0] << " --render out.wav [--seconds N] [--seed S]" << std::endl;
+			return 1;
+		}
+		return render_song(filename, seconds, seed);
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -106,7 +169,8 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	//(small buffer, so the player hears their notes promptly)
+	Sound::init(256);
 
 	//------------ load assets --------------
 	call_load_functions();
@@ -168,6 +232,9 @@ int main(int argc, char **argv) {
 			if (!Mode::current) break;
 		}
 
+		//run any main-thread work (e.g., GL uploads) for assets that are loading in the background:
+		poll_load_functions();
+
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
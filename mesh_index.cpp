@@ -0,0 +1,158 @@
+#include "mesh_index.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <unordered_map>
+
+void deduplicate_vertices(uint8_t const *soup, uint32_t count, uint32_t stride, std::vector< uint8_t > *vertices_, std::vector< uint32_t > *indices_) {
+	assert(vertices_ && indices_);
+	auto &vertices = *vertices_;
+	auto &indices = *indices_;
+	assert(count % 3 == 0);
+
+	vertices.clear();
+	indices.clear();
+	indices.reserve(count);
+
+	//map from soup vertex (compared by contents) to its index in 'vertices':
+	auto hash = [&](uint32_t v) {
+		uint64_t h = 0xcbf29ce484222325ULL; //FNV-1a
+		for (uint32_t b = 0; b < stride; ++b) {
+			h = (h ^ soup[size_t(v) * stride + b]) * 0x100000001b3ULL;
+		}
+		return size_t(h);
+	};
+	auto equal = [&](uint32_t a, uint32_t b) {
+		return std::memcmp(soup + size_t(a) * stride, soup + size_t(b) * stride, stride) == 0;
+	};
+	std::unordered_map< uint32_t, uint32_t, decltype(hash), decltype(equal) > unique(count, hash, equal);
+
+	for (uint32_t v = 0; v < count; ++v) {
+		auto inserted = unique.emplace(v, uint32_t(vertices.size() / stride));
+		if (inserted.second) {
+			vertices.insert(vertices.end(), soup + size_t(v) * stride, soup + size_t(v + 1) * stride);
+		}
+		indices.emplace_back(inserted.first->second);
+	}
+}
+
+void optimize_vertex_cache(uint32_t stride, std::vector< uint8_t > *vertices_, std::vector< uint32_t > *indices_, uint32_t cache_size) {
+	assert(vertices_ && indices_);
+	auto &vertices = *vertices_;
+	auto &indices = *indices_;
+	assert(vertices.size() % stride == 0);
+	assert(indices.size() % 3 == 0);
+
+	uint32_t const vertex_count = uint32_t(vertices.size() / stride);
+	uint32_t const triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0) return;
+
+	//vertex -> triangle adjacency (as offsets into one array):
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (uint32_t i : indices) {
+		assert(i < vertex_count);
+		adjacency_begin[i + 1] += 1;
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		adjacency_begin[v + 1] += adjacency_begin[v];
+	}
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > fill(adjacency_begin.begin(), adjacency_begin.end() - 1);
+		for (uint32_t i = 0; i < uint32_t(indices.size()); ++i) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector< uint32_t > live(vertex_count); //triangles not yet emitted, per vertex
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		live[v] = adjacency_begin[v + 1] - adjacency_begin[v];
+	}
+	std::vector< uint32_t > cache_time(vertex_count, 0); //when each vertex last entered the cache
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > dead_end; //recently-used vertices, for when the fan runs out
+	std::vector< uint32_t > candidates;
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0; //for scanning for any vertex that still has triangles
+
+	std::vector< uint32_t > ordered;
+	ordered.reserve(indices.size());
+
+	int64_t fan = 0; //vertex whose triangles are being emitted
+	while (fan >= 0) {
+		candidates.clear();
+		for (uint32_t a = adjacency_begin[fan]; a < adjacency_begin[fan + 1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * t + c];
+				ordered.emplace_back(v);
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > cache_size) {
+					cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//next fan: the candidate (still in cache after its triangles are emitted) that has been in the cache longest:
+		fan = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best) {
+				best = priority;
+				fan = v;
+			}
+		}
+		//...or a recently-used vertex that still has triangles:
+		while (fan < 0 && !dead_end.empty()) {
+			uint32_t v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) fan = v;
+		}
+		//...or any vertex that still has triangles:
+		while (fan < 0 && cursor < vertex_count) {
+			if (live[cursor] > 0) fan = cursor;
+			++cursor;
+		}
+	}
+	assert(ordered.size() == indices.size());
+
+	//renumber vertices in order of first use:
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	std::vector< uint8_t > reordered;
+	reordered.reserve(vertices.size());
+	for (uint32_t &i : ordered) {
+		if (remap[i] == -1U) {
+			remap[i] = uint32_t(reordered.size() / stride);
+			reordered.insert(reordered.end(), vertices.begin() + size_t(i) * stride, vertices.begin() + size_t(i + 1) * stride);
+		}
+		i = remap[i];
+	}
+	//(vertices no triangle uses are dropped)
+
+	vertices = std::move(reordered);
+	indices = std::move(ordered);
+}
+
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint32_t > entered(vertex_count, 0); //(FIFO position + 1 when the vertex entered the cache; 0 == never)
+	uint32_t fifo = 0;
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		assert(i < vertex_count);
+		if (entered[i] == 0 || fifo - (entered[i] - 1) >= cache_size) {
+			entered[i] = fifo + 1;
+			fifo += 1;
+			misses += 1;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
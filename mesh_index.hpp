@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ * Helpers for turning triangle soup (as stored in '.pnct' files) into indexed triangles
+ * (as stored in '.pnci' files). Used by the index-meshes utility.
+ *
+ * Vertices are treated as opaque 'stride'-byte records, so these work for any vertex format.
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+//Merge byte-identical vertices of 'count' soup vertices (three per triangle) into 'vertices',
+// and write three indices (into 'vertices') per triangle to 'indices':
+void deduplicate_vertices(uint8_t const *soup, uint32_t count, uint32_t stride, std::vector< uint8_t > *vertices, std::vector< uint32_t > *indices);
+
+//Reorder triangles so that vertices are reused while they're still in the post-transform cache
+// (the "Tipsify" algorithm of Sander, Nehab, and Barczak, 2007), then renumber vertices in order
+// of first use so that vertex fetches mostly walk forward through memory:
+void optimize_vertex_cache(uint32_t stride, std::vector< uint8_t > *vertices, std::vector< uint32_t > *indices, uint32_t cache_size = 16);
+
+//Average number of vertices transformed per triangle with a FIFO post-transform cache of 'cache_size' entries
+// (3.0 for soup; ~0.5-0.7 is typical for well-ordered meshes):
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size = 16);
@@ -0,0 +1,91 @@
+#include "opus_stream.hpp"
+
+#include <opusfile.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+//the longest opus packet is 120ms, so this is the most a single op_read_float_stereo() call returns:
+static constexpr uint32_t MAX_READ = 48000 * 120 / 1000;
+
+OpusStream::OpusStream(std::string const &filename_, bool loop_) : filename(filename_), loop(loop_), op(nullptr, op_free) {
+	int err = 0;
+	op.reset(op_open_file(filename.c_str(), &err));
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+	ring.reset(new float[RING_SIZE]);
+	thread = std::thread(&OpusStream::decode, this);
+}
+
+OpusStream::~OpusStream() {
+	{
+		std::unique_lock< std::mutex > guard(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+bool OpusStream::ready() const {
+	return prebuffered.load(std::memory_order_acquire);
+}
+
+uint32_t OpusStream::peek(float const **data) const {
+	uint32_t r = read.load(std::memory_order_relaxed);
+	uint32_t available = written.load(std::memory_order_acquire) - r;
+	*data = ring.get() + (r & (RING_SIZE - 1));
+	return std::min(available, RING_SIZE - (r & (RING_SIZE - 1)));
+}
+
+void OpusStream::consume(uint32_t count) {
+	read.store(read.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+bool OpusStream::finished() const {
+	//(decoded_all is set after the last write, so this sees every sample that will ever be written)
+	return decoded_all.load(std::memory_order_acquire)
+		&& read.load(std::memory_order_relaxed) == written.load(std::memory_order_acquire);
+}
+
+void OpusStream::decode() {
+	std::vector< float > pcm(2 * MAX_READ);
+	bool read_since_seek = false; //(so an empty looping file doesn't spin forever)
+
+	std::unique_lock< std::mutex > guard(mutex);
+	while (!quit) {
+		uint32_t w = written.load(std::memory_order_relaxed);
+		uint32_t space = RING_SIZE - (w - read.load(std::memory_order_acquire));
+		if (space < MAX_READ) {
+			//ring is full; the audio thread doesn't signal, so check back in a bit (a few % of the ring plays in the meantime):
+			wake.wait_for(guard, std::chrono::milliseconds(10));
+			continue;
+		}
+
+		guard.unlock();
+		int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
+		if (ret > 0) {
+			//downmix to mono by averaging, and write into the ring (wrapping around the end):
+			for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+				ring[(w + i) & (RING_SIZE - 1)] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+			}
+			written.store(w + uint32_t(ret), std::memory_order_release);
+			if (w + uint32_t(ret) >= PREBUFFER) prebuffered.store(true, std::memory_order_release);
+			read_since_seek = true;
+		} else if (ret == 0 && loop && read_since_seek && op_pcm_seek(op.get(), 0) == 0) {
+			read_since_seek = false;
+		} else {
+			if (ret < 0) {
+				std::cerr << "WARNING: opusfile read error " << ret << " streaming \"" << filename << "\"; stopping the stream." << std::endl;
+			}
+			decoded_all.store(true, std::memory_order_release);
+			prebuffered.store(true, std::memory_order_release);
+			guard.lock();
+			break;
+		}
+		guard.lock();
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * OpusStream decodes an '.opus' file (as 48kHz mono float) a little at a time on its own thread,
+ * into a ring buffer that the audio callback reads from. A long music track therefore costs a fixed
+ * amount of memory, and can start playing as soon as its first few hundred milliseconds are decoded.
+ *
+ * The decoder thread is the only writer of the ring and the audio thread (see Sound::stream()) the
+ * only reader; neither ever waits for the other. If the decoder falls behind, the reader just gets
+ * less data (and plays silence) until it catches up.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct OggOpusFile;
+
+struct OpusStream {
+	//opens 'filename' (throws on error) and starts decoding; looping streams seek back to the start at the end of the file:
+	OpusStream(std::string const &filename, bool loop);
+	~OpusStream(); //stops (and waits for) the decoder thread
+	OpusStream(OpusStream const &) = delete;
+	OpusStream &operator=(OpusStream const &) = delete;
+
+	//decoded audio held in the ring (about 1.4 seconds), and how much needs to be there before playback starts:
+	static constexpr uint32_t RING_SIZE = 1 << 16;
+	static constexpr uint32_t PREBUFFER = 48000 / 4;
+
+	//reader (audio thread) side:
+	// is enough decoded to start playing? (also true once the whole file is decoded, however short)
+	bool ready() const;
+	// points 'data' at the next contiguous run of decoded samples and returns its length (0 if there's nothing to read):
+	uint32_t peek(float const **data) const;
+	// mark 'count' samples (no more than peek() returned) as read:
+	void consume(uint32_t count);
+	// has the whole file been decoded and read? (never true for looping streams)
+	bool finished() const;
+
+	//internals:
+	void decode(); //decoder thread's main loop
+
+	std::string filename;
+	bool loop = false;
+	std::unique_ptr< OggOpusFile, void (*)(OggOpusFile *) > op;
+
+	//ring buffer; indices count up forever (RING_SIZE divides 2^32):
+	std::unique_ptr< float[] > ring;
+	alignas(64) std::atomic< uint32_t > written{0}; //(decoder thread)
+	alignas(64) std::atomic< uint32_t > read{0}; //(audio thread)
+	std::atomic< bool > prebuffered{false};
+	std::atomic< bool > decoded_all{false};
+
+	//decoder thread sleeps on 'wake' while the ring is full:
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool quit = false; //(protected by mutex)
+	std::thread thread;
+};
@@ -0,0 +1,131 @@
+#include "pcm_cache.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+//cache file layout: this header, then 'count' floats
+// (the header is padded to 64 bytes so the samples start nicely aligned):
+struct PcmCacheHeader {
+	char magic[8];
+	uint64_t source_size;
+	int64_t source_time;
+	uint64_t source_hash;
+	uint64_t count;
+	uint8_t padding[24];
+};
+static_assert(sizeof(PcmCacheHeader) == 64, "PcmCacheHeader is packed");
+
+//(bump the last character if the format -- or the decoders' output -- changes)
+static char const PCM_CACHE_MAGIC[8] = {'p','c','m','4','8','k','1','\0'};
+
+//cache entries live in a '.pcm-cache' directory next to their source:
+static std::filesystem::path cache_path(std::string const &source) {
+	std::filesystem::path path(source);
+	return path.parent_path() / ".pcm-cache" / (path.filename().string() + ".pcm");
+}
+
+//modification time (in the filesystem clock's units; only ever compared on the same machine):
+static bool source_stats(std::string const &source, uint64_t *size, int64_t *time) {
+	std::error_code ec;
+	*size = std::filesystem::file_size(source, ec);
+	if (ec) return false;
+	*time = int64_t(std::filesystem::last_write_time(source, ec).time_since_epoch().count());
+	return !ec;
+}
+
+//64-bit FNV-1a of the file's contents (0 if it can't be read):
+static uint64_t hash_file(std::string const &source) {
+	std::ifstream in(source, std::ios::binary);
+	if (!in) return 0;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	std::vector< char > block(1 << 16);
+	while (in) {
+		in.read(block.data(), block.size());
+		for (std::streamsize i = 0; i < in.gcount(); ++i) {
+			hash = (hash ^ uint8_t(block[i])) * 0x100000001b3ULL;
+		}
+	}
+	return hash;
+}
+
+bool map_cached_pcm(std::string const &source, MappedFile *mapped, float const **data, size_t *count) {
+	uint64_t size;
+	int64_t time;
+	if (!source_stats(source, &size, &time)) return false;
+
+	std::filesystem::path cache = cache_path(source);
+	std::error_code ec;
+	if (!std::filesystem::exists(cache, ec)) return false;
+
+	MappedFile file;
+	try {
+		file = MappedFile(cache.string());
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: couldn't map PCM cache entry: " << e.what() << std::endl;
+		return false;
+	}
+
+	PcmCacheHeader header;
+	if (file.size < sizeof(header)) return false;
+	std::memcpy(&header, file.data, sizeof(header));
+	if (std::memcmp(header.magic, PCM_CACHE_MAGIC, sizeof(PCM_CACHE_MAGIC)) != 0) return false;
+	if (file.size != sizeof(header) + header.count * sizeof(float)) return false;
+	if (header.source_size != size) return false;
+
+	if (header.source_time != time) {
+		//(e.g. the file was touched or copied; only re-decode if its contents actually changed)
+		if (hash_file(source) != header.source_hash) return false;
+		//same contents, so note the new time to skip the hash next run (unmapped readers never look at the header again):
+		std::fstream out(cache, std::ios::in | std::ios::out | std::ios::binary);
+		out.seekp(offsetof(PcmCacheHeader, source_time));
+		out.write(reinterpret_cast< char const * >(&time), sizeof(time));
+	}
+
+	*data = reinterpret_cast< float const * >(file.data + sizeof(header));
+	*count = size_t(header.count);
+	*mapped = std::move(file);
+	return true;
+}
+
+void save_cached_pcm(std::string const &source, std::vector< float > const &data) {
+	PcmCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, PCM_CACHE_MAGIC, sizeof(PCM_CACHE_MAGIC));
+	if (!source_stats(source, &header.source_size, &header.source_time)) return;
+	header.source_hash = hash_file(source);
+	header.count = data.size();
+
+	std::filesystem::path cache = cache_path(source);
+	std::error_code ec;
+	std::filesystem::create_directories(cache.parent_path(), ec);
+	if (ec) {
+		std::cerr << "WARNING: couldn't create PCM cache directory " << cache.parent_path() << " (" << ec.message() << ")." << std::endl;
+		return;
+	}
+
+	//write to a temporary file and rename it into place, so no other process ever sees a partial entry:
+	std::filesystem::path temp = cache;
+	temp += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	{
+		std::ofstream out(temp, std::ios::binary);
+		out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+		out.write(reinterpret_cast< char const * >(data.data()), data.size() * sizeof(float));
+		if (!out) {
+			std::cerr << "WARNING: couldn't write PCM cache entry " << temp << "." << std::endl;
+			out.close();
+			std::filesystem::remove(temp, ec);
+			return;
+		}
+	}
+	std::filesystem::rename(temp, cache, ec);
+	if (ec) {
+		//(e.g. on Windows, when another process has the old entry mapped; it'll get replaced on a later run)
+		std::cerr << "WARNING: couldn't replace PCM cache entry " << cache << " (" << ec.message() << ")." << std::endl;
+		std::filesystem::remove(temp, ec);
+	}
+}
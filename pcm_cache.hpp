@@ -0,0 +1,26 @@
+#pragma once
+
+/*
+ * Disk cache of decoded audio (48kHz mono float PCM), so Sound::Sample can memory-map
+ * samples on later runs instead of decoding them again.
+ *
+ * Each source file gets one cache file, in a '.pcm-cache' directory next to it (so, for the
+ * game's audio, in dist/ -- the directory is in .gitignore, and can be deleted at any time).
+ * If that directory isn't writable, samples are just decoded on every run. The cache
+ * file's header records the source's size, modification time, and content hash:
+ *  - if size and time match, the entry is used as-is (no need to read the source at all);
+ *  - if only the size matches, the source is hashed, and the entry is used if the hash does too;
+ *  - otherwise the source is decoded again and the entry rewritten.
+ *
+ */
+
+#include "MappedFile.hpp"
+
+#include <string>
+#include <vector>
+
+//If there's an up-to-date cache entry for 'source', map it into 'mapped', point 'data' at its samples, and return true:
+bool map_cached_pcm(std::string const &source, MappedFile *mapped, float const **data, size_t *count);
+
+//Cache 'data' (decoded from 'source'); warns (rather than throws) if the cache can't be written:
+void save_cached_pcm(std::string const &source, std::vector< float > const &data);
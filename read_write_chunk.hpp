@@ -4,6 +4,8 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +65,57 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//helper function that finds a chunk (in the same format as read_chunk) in memory -- e.g., in a MappedFile -- without copying it.
+// Returns a pointer to the chunk's data and its element count, and advances 'at' past the chunk:
+// (throws if the data isn't suitably aligned for T; use copy_chunk for chunks that may not be)
+template< typename T >
+T const *map_chunk(uint8_t const **at_, uint8_t const *end, std::string const &magic, size_t *count) {
+	assert(at_ && count);
+	auto &at = *at_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) - sizeof(header) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	T const *data = reinterpret_cast< T const * >(at + sizeof(header));
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is misaligned.");
+	}
+	*count = header.size / sizeof(T);
+	at += sizeof(header) + header.size;
+	return data;
+}
+
+//helper function that copies a chunk out of memory (for chunks that might not be aligned):
+template< typename T >
+void copy_chunk(uint8_t const **at, uint8_t const *end, std::string const &magic, std::vector< T > *to_) {
+	assert(to_);
+	auto &to = *to_;
+	size_t count = 0;
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(map_chunk< char >(at, end, magic, &count));
+	if (count % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	to.resize(count / sizeof(T));
+	if (count) std::memcpy(to.data(), data, count);
+}
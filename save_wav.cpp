@@ -0,0 +1,56 @@
+#include "save_wav.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <cassert>
+
+//WAV is little-endian, as is every platform we build for:
+static_assert(sizeof(float) == 4, "float is 32 bits");
+
+template< typename T >
+static void write_le(std::ofstream &out, T const &value) {
+	out.write(reinterpret_cast< char const * >(&value), sizeof(T));
+}
+
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels, uint32_t rate) {
+	assert(channels > 0);
+	assert(data.size() % channels == 0);
+
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+	}
+
+	uint32_t data_bytes = uint32_t(data.size() * sizeof(float));
+	uint32_t frames = uint32_t(data.size() / channels);
+
+	//RIFF header:
+	out.write("RIFF", 4);
+	write_le< uint32_t >(out, 4 + (8 + 18) + (8 + 4) + (8 + data_bytes));
+	out.write("WAVE", 4);
+
+	//format chunk (WAVE_FORMAT_IEEE_FLOAT):
+	out.write("fmt ", 4);
+	write_le< uint32_t >(out, 18);
+	write_le< uint16_t >(out, 3); //format tag
+	write_le< uint16_t >(out, uint16_t(channels));
+	write_le< uint32_t >(out, rate);
+	write_le< uint32_t >(out, rate * channels * uint32_t(sizeof(float))); //bytes per second
+	write_le< uint16_t >(out, uint16_t(channels * sizeof(float))); //block align
+	write_le< uint16_t >(out, 32); //bits per sample
+	write_le< uint16_t >(out, 0); //extension size
+
+	//non-PCM formats also carry a 'fact' chunk with the frame count:
+	out.write("fact", 4);
+	write_le< uint32_t >(out, 4);
+	write_le< uint32_t >(out, frames);
+
+	//sample data:
+	out.write("data", 4);
+	write_le< uint32_t >(out, data_bytes);
+	out.write(reinterpret_cast< char const * >(data.data()), data_bytes);
+
+	if (!out) {
+		throw std::runtime_error("Failed to write WAV data to '" + filename + "'.");
+	}
+}
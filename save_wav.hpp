@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Save interleaved floating-point samples as a 32-bit float WAV file; throws on error:
+void save_wav(std::string const &filename, std::vector< float > const &data, uint32_t channels, uint32_t rate);
@@ -107,7 +107,7 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform transform, std::string const &mesh_name){
 				if (!buffer_vao) return;
 				Mesh const &mesh = buffer->lookup(mesh_name);
 
@@ -120,6 +120,9 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_to_object = mesh.position_to_object;
+				drawable.pipeline.octahedral_normals = mesh.octahedral_normals;
 
 			});
 		} catch (std::exception &e) {
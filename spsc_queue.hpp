@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+ * SPSCQueue is a fixed-size, wait-free, single-producer/single-consumer ring buffer.
+ *
+ * Exactly one thread may call push() and exactly one (other) thread may call pop().
+ * Neither call ever blocks or allocates; push() fails if the ring is full, pop() fails if it is empty.
+ *
+ * Used to hand commands from the game thread to the audio callback (see Sound.cpp)
+ * without Sound::lock(), which would stall the callback.
+ *
+ */
+
+#include <atomic>
+#include <cstdint>
+
+template< typename T, uint32_t Size >
+struct SPSCQueue {
+	static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "SPSCQueue size must be a power of two");
+
+	//producer side:
+	bool push(T const &value) {
+		uint32_t w = write.load(std::memory_order_relaxed);
+		if (w - read_cache == Size) {
+			read_cache = read.load(std::memory_order_acquire);
+			if (w - read_cache == Size) return false; //full
+		}
+		slots[w & (Size - 1)] = value;
+		write.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer side:
+	bool pop(T *value) {
+		uint32_t r = read.load(std::memory_order_relaxed);
+		if (r == write_cache) {
+			write_cache = write.load(std::memory_order_acquire);
+			if (r == write_cache) return false; //empty
+		}
+		*value = slots[r & (Size - 1)];
+		read.store(r + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(approximate unless called from one of the two threads while the other is idle)
+	bool empty() const {
+		return read.load(std::memory_order_acquire) == write.load(std::memory_order_acquire);
+	}
+
+	//internals:
+	// indices count up forever (wrapping is fine since Size divides 2^32);
+	// each side keeps its own cache line plus a cached copy of the other side's index:
+	alignas(64) std::atomic< uint32_t > write{0};
+	uint32_t read_cache = 0; //producer's copy of 'read'
+	alignas(64) std::atomic< uint32_t > read{0};
+	uint32_t write_cache = 0; //consumer's copy of 'write'
+	alignas(64) T slots[Size];
+};
@@ -0,0 +1,538 @@
+#include "synth_kernels.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SYNTH_KERNELS_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SYNTH_KERNELS_SSE2
+#endif
+
+//NOTE: the SIMD paths evaluate the same expressions (in the same order) as the scalar tails,
+// so output is identical whichever path handles a given sample.
+// (the exception is kernel_exponential_ramp, whose lanes start from precomputed powers of 'mul'
+//  rather than repeated multiplies; the difference is a few ulp.)
+
+#if defined(SYNTH_KERNELS_SSE2)
+//helper: four lanes of wavetable lookup (SSE2 has no gather, so indices go through memory):
+static inline __m128 wavetable4(float const *table, __m128i phases, __m128i shift, __m128i mask, __m128 scale) {
+	alignas(16) int32_t idx[4];
+	_mm_store_si128(reinterpret_cast< __m128i * >(idx), _mm_srl_epi32(phases, shift));
+	__m128 a = _mm_setr_ps(table[idx[0]], table[idx[1]], table[idx[2]], table[idx[3]]);
+	__m128 b = _mm_setr_ps(table[idx[0]+1], table[idx[1]+1], table[idx[2]+1], table[idx[3]+1]);
+	__m128 frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(phases, mask)), scale);
+	return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), frac));
+}
+#endif
+
+void kernel_wavetable(float const *table, uint32_t frac_bits, uint32_t *phase_, uint32_t phase_step, uint32_t n, float *out) {
+	uint32_t phase = *phase_;
+	uint32_t const mask = (1U << frac_bits) - 1;
+	float const scale = 1.0f / float(1U << frac_bits);
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256i phases = _mm256_add_epi32(_mm256_set1_epi32(int32_t(phase)),
+			_mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(int32_t(phase_step))));
+		__m256i const step8 = _mm256_set1_epi32(int32_t(phase_step * 8));
+		__m128i const shift = _mm_cvtsi32_si128(int32_t(frac_bits));
+		__m256i const mask8 = _mm256_set1_epi32(int32_t(mask));
+		__m256 const scale8 = _mm256_set1_ps(scale);
+		for (; i + 8 <= n; i += 8) {
+			__m256i idx = _mm256_srl_epi32(phases, shift);
+			__m256 a = _mm256_i32gather_ps(table, idx, 4);
+			__m256 b = _mm256_i32gather_ps(table + 1, idx, 4);
+			__m256 frac = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(phases, mask8)), scale8);
+			_mm256_storeu_ps(out + i, _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), frac)));
+			phases = _mm256_add_epi32(phases, step8);
+		}
+		phase += phase_step * i;
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128i lo = _mm_setr_epi32(int32_t(phase), int32_t(phase + phase_step), int32_t(phase + 2 * phase_step), int32_t(phase + 3 * phase_step));
+		__m128i const step4 = _mm_set1_epi32(int32_t(phase_step * 4));
+		__m128i hi = _mm_add_epi32(lo, step4);
+		__m128i const step8 = _mm_set1_epi32(int32_t(phase_step * 8));
+		__m128i const shift = _mm_cvtsi32_si128(int32_t(frac_bits));
+		__m128i const mask4 = _mm_set1_epi32(int32_t(mask));
+		__m128 const scale4 = _mm_set1_ps(scale);
+		for (; i + 8 <= n; i += 8) {
+			_mm_storeu_ps(out + i, wavetable4(table, lo, shift, mask4, scale4));
+			_mm_storeu_ps(out + i + 4, wavetable4(table, hi, shift, mask4, scale4));
+			lo = _mm_add_epi32(lo, step8);
+			hi = _mm_add_epi32(hi, step8);
+		}
+		phase += phase_step * i;
+	}
+#endif
+
+	for (; i < n; ++i) {
+		uint32_t index = phase >> frac_bits;
+		float frac = float(phase & mask) * scale;
+		out[i] = table[index] + (table[index+1] - table[index]) * frac;
+		phase += phase_step;
+	}
+
+	*phase_ = phase;
+}
+
+float kernel_linear_ramp(float level, float step, uint32_t n, float *out) {
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256 k = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 const eight = _mm256_set1_ps(8.0f);
+		__m256 const level8 = _mm256_set1_ps(level);
+		__m256 const step8 = _mm256_set1_ps(step);
+		for (; i + 8 <= n; i += 8) {
+			_mm256_storeu_ps(out + i, _mm256_add_ps(level8, _mm256_mul_ps(step8, k)));
+			k = _mm256_add_ps(k, eight);
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128 k = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 const four = _mm_set1_ps(4.0f);
+		__m128 const level4 = _mm_set1_ps(level);
+		__m128 const step4 = _mm_set1_ps(step);
+		for (; i + 8 <= n; i += 8) {
+			_mm_storeu_ps(out + i, _mm_add_ps(level4, _mm_mul_ps(step4, k)));
+			k = _mm_add_ps(k, four);
+			_mm_storeu_ps(out + i + 4, _mm_add_ps(level4, _mm_mul_ps(step4, k)));
+			k = _mm_add_ps(k, four);
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = level + step * float(i);
+	}
+
+	return level + step * float(n);
+}
+
+float kernel_exponential_ramp(float level, float goal, float mul, uint32_t n, float *out) {
+	//offset from goal at the current sample; shrinks by 'mul' every sample:
+	float offset = level - goal;
+	uint32_t i = 0;
+
+	//mul^0 .. mul^7 (per-lane starting powers) and mul^8 (per-iteration step):
+	float powers[8];
+	powers[0] = 1.0f;
+	for (uint32_t j = 1; j < 8; ++j) powers[j] = powers[j-1] * mul;
+	float const mul8 = powers[7] * mul;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256 const powers8 = _mm256_loadu_ps(powers);
+		__m256 const goal8 = _mm256_set1_ps(goal);
+		for (; i + 8 <= n; i += 8) {
+			_mm256_storeu_ps(out + i, _mm256_add_ps(goal8, _mm256_mul_ps(_mm256_set1_ps(offset), powers8)));
+			offset *= mul8;
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128 const powers_lo = _mm_loadu_ps(powers);
+		__m128 const powers_hi = _mm_loadu_ps(powers + 4);
+		__m128 const goal4 = _mm_set1_ps(goal);
+		for (; i + 8 <= n; i += 8) {
+			__m128 offset4 = _mm_set1_ps(offset);
+			_mm_storeu_ps(out + i, _mm_add_ps(goal4, _mm_mul_ps(offset4, powers_lo)));
+			_mm_storeu_ps(out + i + 4, _mm_add_ps(goal4, _mm_mul_ps(offset4, powers_hi)));
+			offset *= mul8;
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = goal + offset;
+		offset *= mul;
+	}
+
+	return goal + offset;
+}
+
+//noise hash constants (from the "lowbias32" integer hash), with the key mixed in between rounds:
+static constexpr uint32_t NOISE_M1 = 0x7feb352dU;
+static constexpr uint32_t NOISE_M2 = 0x846ca68bU;
+static constexpr uint32_t NOISE_KEY2 = 0x9e3779b9U; //second key for the triangular stream
+
+static inline uint32_t noise_key(uint32_t seed) {
+	seed ^= seed >> 16;
+	seed *= NOISE_M2;
+	seed ^= seed >> 15;
+	return seed;
+}
+
+static inline uint32_t noise_round(uint32_t x, uint32_t seed, uint32_t key) {
+	x ^= seed;
+	x ^= x >> 16;
+	x *= NOISE_M1;
+	x ^= x >> 15;
+	x ^= key;
+	x *= NOISE_M2;
+	x ^= x >> 16;
+	return x;
+}
+
+//top 24 bits of the hash as a float in [-1,1):
+static inline float noise_to_float(uint32_t x) {
+	return float(int32_t(x) >> 8) * (1.0f / float(1 << 23));
+}
+
+uint32_t noise_hash(uint32_t seed, uint32_t counter) {
+	return noise_round(counter, seed, noise_key(seed));
+}
+
+#if defined(SYNTH_KERNELS_AVX2)
+static inline __m256 noise8(__m256i x, __m256i seed, __m256i key) {
+	__m256i const m1 = _mm256_set1_epi32(int32_t(NOISE_M1));
+	__m256i const m2 = _mm256_set1_epi32(int32_t(NOISE_M2));
+	x = _mm256_xor_si256(x, seed);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	x = _mm256_mullo_epi32(x, m1);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+	x = _mm256_xor_si256(x, key);
+	x = _mm256_mullo_epi32(x, m2);
+	x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+	return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srai_epi32(x, 8)), _mm256_set1_ps(1.0f / float(1 << 23)));
+}
+#elif defined(SYNTH_KERNELS_SSE2)
+//SSE2 has no 32-bit low multiply, so build one out of two 32x32->64 multiplies:
+static inline __m128i mullo4(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static inline __m128 noise4(__m128i x, __m128i seed, __m128i key) {
+	__m128i const m1 = _mm_set1_epi32(int32_t(NOISE_M1));
+	__m128i const m2 = _mm_set1_epi32(int32_t(NOISE_M2));
+	x = _mm_xor_si128(x, seed);
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	x = mullo4(x, m1);
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+	x = _mm_xor_si128(x, key);
+	x = mullo4(x, m2);
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+	return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(x, 8)), _mm_set1_ps(1.0f / float(1 << 23)));
+}
+#endif
+
+void kernel_noise_uniform(uint32_t seed, uint32_t counter, uint32_t n, float *out) {
+	uint32_t const key = noise_key(seed);
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256i const seed8 = _mm256_set1_epi32(int32_t(seed));
+		__m256i const key8 = _mm256_set1_epi32(int32_t(key));
+		__m256i x = _mm256_add_epi32(_mm256_set1_epi32(int32_t(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i const eight = _mm256_set1_epi32(8);
+		for (; i + 8 <= n; i += 8) {
+			_mm256_storeu_ps(out + i, noise8(x, seed8, key8));
+			x = _mm256_add_epi32(x, eight);
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128i const seed4 = _mm_set1_epi32(int32_t(seed));
+		__m128i const key4 = _mm_set1_epi32(int32_t(key));
+		__m128i x = _mm_add_epi32(_mm_set1_epi32(int32_t(counter)), _mm_setr_epi32(0, 1, 2, 3));
+		__m128i const four = _mm_set1_epi32(4);
+		for (; i + 8 <= n; i += 8) {
+			_mm_storeu_ps(out + i, noise4(x, seed4, key4));
+			x = _mm_add_epi32(x, four);
+			_mm_storeu_ps(out + i + 4, noise4(x, seed4, key4));
+			x = _mm_add_epi32(x, four);
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = noise_to_float(noise_round(counter + i, seed, key));
+	}
+}
+
+void kernel_noise_triangular(uint32_t seed, uint32_t counter, uint32_t n, float *out) {
+	uint32_t const seed2 = seed + NOISE_KEY2;
+	uint32_t const key = noise_key(seed);
+	uint32_t const key2 = noise_key(seed2);
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256i const seed8 = _mm256_set1_epi32(int32_t(seed));
+		__m256i const key8 = _mm256_set1_epi32(int32_t(key));
+		__m256i const seed2_8 = _mm256_set1_epi32(int32_t(seed2));
+		__m256i const key2_8 = _mm256_set1_epi32(int32_t(key2));
+		__m256 const half = _mm256_set1_ps(0.5f);
+		__m256i x = _mm256_add_epi32(_mm256_set1_epi32(int32_t(counter)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256i const eight = _mm256_set1_epi32(8);
+		for (; i + 8 <= n; i += 8) {
+			__m256 a = noise8(x, seed8, key8);
+			__m256 b = noise8(x, seed2_8, key2_8);
+			_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_add_ps(a, b), half));
+			x = _mm256_add_epi32(x, eight);
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128i const seed4 = _mm_set1_epi32(int32_t(seed));
+		__m128i const key4 = _mm_set1_epi32(int32_t(key));
+		__m128i const seed2_4 = _mm_set1_epi32(int32_t(seed2));
+		__m128i const key2_4 = _mm_set1_epi32(int32_t(key2));
+		__m128 const half = _mm_set1_ps(0.5f);
+		__m128i x = _mm_add_epi32(_mm_set1_epi32(int32_t(counter)), _mm_setr_epi32(0, 1, 2, 3));
+		__m128i const four = _mm_set1_epi32(4);
+		for (; i + 4 <= n; i += 4) {
+			__m128 a = noise4(x, seed4, key4);
+			__m128 b = noise4(x, seed2_4, key2_4);
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(a, b), half));
+			x = _mm_add_epi32(x, four);
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		float a = noise_to_float(noise_round(counter + i, seed, key));
+		float b = noise_to_float(noise_round(counter + i, seed2, key2));
+		out[i] = (a + b) * 0.5f;
+	}
+}
+
+//Paul Kellet's "economy" pink noise filter (three one-pole lowpasses + direct path);
+// it is recursive, so it stays scalar:
+void kernel_pink_filter(float *state, uint32_t n, float *inout) {
+	float b0 = state[0], b1 = state[1], b2 = state[2];
+	for (uint32_t i = 0; i < n; ++i) {
+		float white = inout[i];
+		b0 = 0.99765f * b0 + white * 0.0990460f;
+		b1 = 0.96300f * b1 + white * 0.2965164f;
+		b2 = 0.57000f * b2 + white * 1.0526913f;
+		//(scaled so peaks stay roughly in [-1,1])
+		inout[i] = (b0 + b1 + b2 + white * 0.1848f) * 0.15f;
+	}
+	state[0] = b0;
+	state[1] = b1;
+	state[2] = b2;
+}
+
+SvfCoefficients svf_coefficients(SvfMode mode, float cutoff, float resonance) {
+	cutoff = std::min(std::max(cutoff, 0.0f), 0.49f);
+	resonance = std::max(resonance, 0.05f);
+
+	SvfCoefficients ret;
+	float g = std::tan(3.1415926f * cutoff);
+	float k = 1.0f / resonance;
+	ret.a1 = 1.0f / (1.0f + g * (g + k));
+	ret.a2 = g * ret.a1;
+	ret.a3 = g * ret.a2;
+	if (mode == SVF_LOWPASS) {
+		ret.m0 = 0.0f; ret.m1 = 0.0f; ret.m2 = 1.0f;
+	} else if (mode == SVF_BANDPASS) {
+		ret.m0 = 0.0f; ret.m1 = 1.0f; ret.m2 = 0.0f;
+	} else { //SVF_HIGHPASS
+		ret.m0 = 1.0f; ret.m1 = -k; ret.m2 = -1.0f;
+	}
+	return ret;
+}
+
+void kernel_svf(uint32_t lanes, SvfCoefficients const *const *coefficients, float *const *state, float *const *io, uint32_t n) {
+	assert(lanes <= SVF_LANES);
+
+	//each lane runs:
+	// v3 = in - ic2; v1 = a1 * ic1 + a2 * v3; v2 = (ic2 + a2 * ic1) + a3 * v3;
+	// ic1 = 2 * v1 - ic1; ic2 = 2 * v2 - ic2; out = (m0 * in + m1 * v1) + m2 * v2
+	// the recursion is along time, so the SIMD path works across lanes, transposing 4x4 tiles of samples in and out.
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2) || defined(SYNTH_KERNELS_SSE2)
+	{
+		alignas(16) float c[6][SVF_LANES] = {};
+		alignas(16) float ic[2][SVF_LANES] = {};
+		for (uint32_t l = 0; l < lanes; ++l) {
+			c[0][l] = coefficients[l]->a1; c[1][l] = coefficients[l]->a2; c[2][l] = coefficients[l]->a3;
+			c[3][l] = coefficients[l]->m0; c[4][l] = coefficients[l]->m1; c[5][l] = coefficients[l]->m2;
+			ic[0][l] = state[l][0]; ic[1][l] = state[l][1];
+		}
+		__m128 const a1 = _mm_load_ps(c[0]), a2 = _mm_load_ps(c[1]), a3 = _mm_load_ps(c[2]);
+		__m128 const m0 = _mm_load_ps(c[3]), m1 = _mm_load_ps(c[4]), m2 = _mm_load_ps(c[5]);
+		__m128 const two = _mm_set1_ps(2.0f);
+		__m128 ic1 = _mm_load_ps(ic[0]), ic2 = _mm_load_ps(ic[1]);
+
+		for (; i + 4 <= n; i += 4) {
+			__m128 r[4];
+			for (uint32_t l = 0; l < 4; ++l) {
+				r[l] = (l < lanes ? _mm_loadu_ps(io[l] + i) : _mm_setzero_ps());
+			}
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			for (uint32_t t = 0; t < 4; ++t) {
+				__m128 v0 = r[t];
+				__m128 v3 = _mm_sub_ps(v0, ic2);
+				__m128 v1 = _mm_add_ps(_mm_mul_ps(a1, ic1), _mm_mul_ps(a2, v3));
+				__m128 v2 = _mm_add_ps(_mm_add_ps(ic2, _mm_mul_ps(a2, ic1)), _mm_mul_ps(a3, v3));
+				ic1 = _mm_sub_ps(_mm_mul_ps(two, v1), ic1);
+				ic2 = _mm_sub_ps(_mm_mul_ps(two, v2), ic2);
+				r[t] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, v0), _mm_mul_ps(m1, v1)), _mm_mul_ps(m2, v2));
+			}
+			_MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+			for (uint32_t l = 0; l < lanes; ++l) {
+				_mm_storeu_ps(io[l] + i, r[l]);
+			}
+		}
+
+		_mm_store_ps(ic[0], ic1);
+		_mm_store_ps(ic[1], ic2);
+		for (uint32_t l = 0; l < lanes; ++l) {
+			state[l][0] = ic[0][l];
+			state[l][1] = ic[1][l];
+		}
+	}
+#endif
+
+	for (uint32_t l = 0; l < lanes; ++l) {
+		SvfCoefficients const &c = *coefficients[l];
+		float ic1 = state[l][0], ic2 = state[l][1];
+		for (uint32_t j = i; j < n; ++j) {
+			float v0 = io[l][j];
+			float v3 = v0 - ic2;
+			float v1 = c.a1 * ic1 + c.a2 * v3;
+			float v2 = (ic2 + c.a2 * ic1) + c.a3 * v3;
+			ic1 = 2.0f * v1 - ic1;
+			ic2 = 2.0f * v2 - ic2;
+			io[l][j] = (c.m0 * v0 + c.m1 * v1) + c.m2 * v2;
+		}
+		//flush decaying state to zero before it turns denormal (and slow):
+		if (std::abs(ic1) < 1e-20f) ic1 = 0.0f;
+		if (std::abs(ic2) < 1e-20f) ic2 = 0.0f;
+		state[l][0] = ic1;
+		state[l][1] = ic2;
+	}
+}
+
+void kernel_fill(float value, uint32_t n, float *out) {
+	for (uint32_t i = 0; i < n; ++i) {
+		out[i] = value;
+	}
+}
+
+void kernel_mul_add(float const *a, float scale, float const *b, uint32_t n, float *out) {
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256 const scale8 = _mm256_set1_ps(scale);
+		for (; i + 8 <= n; i += 8) {
+			__m256 v = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), scale8), _mm256_loadu_ps(b + i));
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), v));
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128 const scale4 = _mm_set1_ps(scale);
+		for (; i + 8 <= n; i += 8) {
+			__m128 v0 = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(a + i), scale4), _mm_loadu_ps(b + i));
+			__m128 v1 = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(a + i + 4), scale4), _mm_loadu_ps(b + i + 4));
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), v0));
+			_mm_storeu_ps(out + i + 4, _mm_add_ps(_mm_loadu_ps(out + i + 4), v1));
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] += (a[i] * scale) * b[i];
+	}
+}
+
+void kernel_mix_stereo(float const *in, float left, float left_step, float right, float right_step, uint32_t n, float *out) {
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256 k = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		__m256 const eight = _mm256_set1_ps(8.0f);
+		__m256 const left8 = _mm256_set1_ps(left);
+		__m256 const left_step8 = _mm256_set1_ps(left_step);
+		__m256 const right8 = _mm256_set1_ps(right);
+		__m256 const right_step8 = _mm256_set1_ps(right_step);
+		for (; i + 8 <= n; i += 8) {
+			__m256 v = _mm256_loadu_ps(in + i);
+			__m256 l = _mm256_mul_ps(v, _mm256_add_ps(left8, _mm256_mul_ps(left_step8, k)));
+			__m256 r = _mm256_mul_ps(v, _mm256_add_ps(right8, _mm256_mul_ps(right_step8, k)));
+			k = _mm256_add_ps(k, eight);
+			//interleave (unpack works within 128-bit halves, so the halves need swapping back into order):
+			__m256 lo = _mm256_unpacklo_ps(l, r); //l0 r0 l1 r1 | l4 r4 l5 r5
+			__m256 hi = _mm256_unpackhi_ps(l, r); //l2 r2 l3 r3 | l6 r6 l7 r7
+			float *o = out + 2 * i;
+			_mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), _mm256_permute2f128_ps(lo, hi, 0x20)));
+			_mm256_storeu_ps(o + 8, _mm256_add_ps(_mm256_loadu_ps(o + 8), _mm256_permute2f128_ps(lo, hi, 0x31)));
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128 k = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		__m128 const four = _mm_set1_ps(4.0f);
+		__m128 const left4 = _mm_set1_ps(left);
+		__m128 const left_step4 = _mm_set1_ps(left_step);
+		__m128 const right4 = _mm_set1_ps(right);
+		__m128 const right_step4 = _mm_set1_ps(right_step);
+		for (; i + 4 <= n; i += 4) {
+			__m128 v = _mm_loadu_ps(in + i);
+			__m128 l = _mm_mul_ps(v, _mm_add_ps(left4, _mm_mul_ps(left_step4, k)));
+			__m128 r = _mm_mul_ps(v, _mm_add_ps(right4, _mm_mul_ps(right_step4, k)));
+			k = _mm_add_ps(k, four);
+			float *o = out + 2 * i;
+			_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), _mm_unpacklo_ps(l, r)));
+			_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), _mm_unpackhi_ps(l, r)));
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[2 * i] += in[i] * (left + left_step * float(i));
+		out[2 * i + 1] += in[i] * (right + right_step * float(i));
+	}
+}
+
+void kernel_downmix_stereo(float const *in, uint32_t n, float *out) {
+	uint32_t i = 0;
+
+#if defined(SYNTH_KERNELS_AVX2)
+	{
+		__m256 const half8 = _mm256_set1_ps(0.5f);
+		for (; i + 8 <= n; i += 8) {
+			__m256 a = _mm256_loadu_ps(in + 2 * i); //l0 r0 l1 r1 | l2 r2 l3 r3
+			__m256 b = _mm256_loadu_ps(in + 2 * i + 8); //l4 r4 l5 r5 | l6 r6 l7 r7
+			//shuffle works within 128-bit halves, so the results come out as 0 1 4 5 | 2 3 6 7:
+			__m256 l = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m256 r = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			__m256 m = _mm256_mul_ps(_mm256_add_ps(l, r), half8);
+			_mm256_storeu_ps(out + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0))));
+		}
+	}
+#elif defined(SYNTH_KERNELS_SSE2)
+	{
+		__m128 const half4 = _mm_set1_ps(0.5f);
+		for (; i + 4 <= n; i += 4) {
+			__m128 a = _mm_loadu_ps(in + 2 * i); //l0 r0 l1 r1
+			__m128 b = _mm_loadu_ps(in + 2 * i + 4); //l2 r2 l3 r3
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(l, r), half4));
+		}
+	}
+#endif
+
+	for (; i < n; ++i) {
+		out[i] = (in[2 * i] + in[2 * i + 1]) * 0.5f;
+	}
+}
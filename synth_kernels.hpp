@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Block-oriented DSP kernels used by GlitchSynth's renderer.
+ *
+ * Each kernel processes a whole run of samples with no per-sample branching.
+ * When the compiler targets AVX2 (-mavx2) or SSE2 (any x86-64 build) the
+ * kernels use those instructions (8 samples per iteration); otherwise they
+ * fall back to plain scalar loops that compute exactly the same expressions.
+ *
+ */
+
+#include <cstdint>
+
+//Read 'n' samples from a wavetable of (1 << (32 - frac_bits)) + 1 entries,
+// advancing the 0.32 fixed-point 'phase' by 'phase_step' per sample:
+// out[i] = lerp(table[index], table[index+1], frac)
+void kernel_wavetable(float const *table, uint32_t frac_bits, uint32_t *phase, uint32_t phase_step, uint32_t n, float *out);
+
+//Write 'n' samples of a linear ramp that starts at 'level' and moves by 'step' every sample:
+// out[i] = level + step * i; returns the level after the last sample
+float kernel_linear_ramp(float level, float step, uint32_t n, float *out);
+
+//Write 'n' samples of an exponential ramp that starts at 'level' and heads toward 'goal':
+// out[i] = goal + (level - goal) * mul^i; returns the level after the last sample
+float kernel_exponential_ramp(float level, float goal, float mul, uint32_t n, float *out);
+
+//Counter-based noise: sample i of a stream is a keyed hash of (counter + i), so a stream
+// comes out the same no matter how it is split into blocks (and voices never share state).
+// noise_hash() is the scalar hash; the kernels write values in [-1,1):
+uint32_t noise_hash(uint32_t seed, uint32_t counter);
+void kernel_noise_uniform(uint32_t seed, uint32_t counter, uint32_t n, float *out);
+//(average of two independent streams -- peaked at zero)
+void kernel_noise_triangular(uint32_t seed, uint32_t counter, uint32_t n, float *out);
+
+//Filter white noise in-place to (approximately) pink, -3dB/octave; 'state' holds three floats
+// that carry the filter over between calls:
+void kernel_pink_filter(float *state, uint32_t n, float *inout);
+
+//State-variable filter (the trapezoidal "TPT" form, which stays stable under fast parameter changes).
+// Coefficients come from svf_coefficients(); the output is m0 * input + m1 * bandpass + m2 * lowpass,
+// so the same structure gives lowpass, bandpass, and highpass. The default is a pass-through.
+struct SvfCoefficients {
+	float a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+	float m0 = 1.0f, m1 = 0.0f, m2 = 0.0f;
+};
+enum SvfMode {
+	SVF_LOWPASS,
+	SVF_BANDPASS,
+	SVF_HIGHPASS
+};
+//'cutoff' is a fraction of the sample rate (clamped below Nyquist); 'resonance' is Q (0.707 == no peak):
+SvfCoefficients svf_coefficients(SvfMode mode, float cutoff, float resonance);
+
+//Filter up to SVF_LANES independent signals in-place at once, one per SIMD lane
+// (io[l], coefficients[l], and state[l] -- two floats carried between calls -- belong to lane l):
+constexpr uint32_t SVF_LANES = 4;
+void kernel_svf(uint32_t lanes, SvfCoefficients const *const *coefficients, float *const *state, float *const *io, uint32_t n);
+
+//Write 'n' copies of 'value':
+void kernel_fill(float value, uint32_t n, float *out);
+
+//Accumulate a scaled product:
+// out[i] += (a[i] * scale) * b[i]
+void kernel_mul_add(float const *a, float scale, float const *b, uint32_t n, float *out);
+
+//Mix a mono signal into interleaved stereo, with left and right gains that move linearly across the run:
+// out[2i] += in[i] * (left + left_step * i), out[2i+1] += in[i] * (right + right_step * i)
+void kernel_mix_stereo(float const *in, float left, float left_step, float right, float right_step, uint32_t n, float *out);
+
+//Downmix interleaved stereo to mono by averaging:
+// out[i] = (in[2i] + in[2i+1]) * 0.5
+void kernel_downmix_stereo(float const *in, uint32_t n, float *out);